@@ -4,9 +4,10 @@
 # Adopted from CS 241 @ The University of Illinois
 
 for $file (<examples/*>){
-	if( $file =~ /proc(\d+)-c(\d+)-(\w+)\.out/){
+	# an optional -p<params> part of the name is passed on as it is
+	if( $file =~ /proc(\d+)-c(\d+)-(\w+?)(-p[\w=,]+)?\.out/){
 	#	print "Proc $1 CORE $2 Proc $3\n";
-		`./simulator -c $2 -s $3 examples/proc$1.csv | tail -7 > output1`;
+		`./simulator -c $2 -s $3 $4 examples/proc$1.csv | tail -7 > output1`;
 		`tail -7 $file > output2`;
 		$diff = `diff output1 output2`;
 		if($diff){
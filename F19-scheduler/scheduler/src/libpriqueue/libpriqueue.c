@@ -3,10 +3,677 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "libpriqueue.h"
 
 
+//the hot-path counters cost nothing unless they are compiled in
+#ifdef PRIQUEUE_COUNTERS
+#define COUNT(q, field, n) ((q)->counters.field += (n))
+#else
+#define COUNT(q, field, n) ((void)0)
+#endif
+
+
+/*
+  Node pool.
+
+  Nodes are allocated in slabs that double in size up to NODE_SLAB_MAX
+  nodes. A node that leaves the queue goes onto a free list and is handed
+  out again by the next offer, so a queue whose size stays bounded stops
+  calling malloc once it has warmed up.
+*/
+#define NODE_SLAB_MIN 16
+#define NODE_SLAB_MAX 4096
+
+static Node *node_get(priqueue_t *q)
+{
+	Node *n = q->free_nodes;
+	q->alloc.nodes++;
+	if(n != NULL)
+	{
+		q->free_nodes = n->next;
+		q->alloc.recycled++;
+		return n;
+	}
+
+	int count = (q->slabs == NULL) ? NODE_SLAB_MIN : q->slabs->count * 2;
+	if(count > NODE_SLAB_MAX)
+	{
+		count = NODE_SLAB_MAX;
+	}
+	NodeSlab *slab = malloc(sizeof(NodeSlab) + count * sizeof(Node));
+	q->alloc.mallocs++;
+	slab->count = count;
+	slab->next = q->slabs;
+	q->slabs = slab;
+
+	//keep the first node, thread the rest onto the free list
+	int i;
+	for(i = count - 1 ; i > 0 ; i--)
+	{
+		slab->nodes[i].next = q->free_nodes;
+		q->free_nodes = &slab->nodes[i];
+	}
+	return &slab->nodes[0];
+}
+
+static void node_put(priqueue_t *q, Node *n)
+{
+	n->data = NULL;
+	n->next = q->free_nodes;
+	q->free_nodes = n;
+}
+
+
+//every call of the comparer goes through here, so it can be counted
+static inline int compare(priqueue_t *q, const void *a, const void *b)
+{
+	COUNT(q, compares, 1);
+	return q->comparer(a, b);
+}
+
+
+/*
+  Binary heap backend.
+
+  The heap holds Node pointers so every element keeps its own sequence
+  number (insertion order) and its current slot in the array. Ties from
+  the comparer are broken by the sequence number, which gives the same
+  FIFO order among equal elements that the linked list produces.
+*/
+
+//orders two nodes: comparer first, then insertion order
+static int heap_compare(priqueue_t *q, Node *a, Node *b)
+{
+	int c = compare(q, a->data, b->data);
+	if(c == 0)
+	{
+		c = (a->seq < b->seq) ? -1 : 1;
+	}
+	return c;
+}
+
+static void heap_place(priqueue_t *q, Node *n, int pos)
+{
+	q->heap[pos] = n;
+	n->pos = pos;
+}
+
+static void heap_sift_up(priqueue_t *q, int pos)
+{
+	Node *n = q->heap[pos];
+	while(pos > 0)
+	{
+		int parent = (pos - 1) / 2;
+		COUNT(q, traversed, 1);
+		if(heap_compare(q, n, q->heap[parent]) >= 0)
+		{
+			break;
+		}
+		heap_place(q, q->heap[parent], pos);
+		pos = parent;
+	}
+	heap_place(q, n, pos);
+}
+
+static void heap_sift_down(priqueue_t *q, int pos)
+{
+	Node *n = q->heap[pos];
+	while(1)
+	{
+		int child = 2 * pos + 1;
+		if(child >= q->size)
+		{
+			break;
+		}
+		COUNT(q, traversed, 1);
+		if(child + 1 < q->size && heap_compare(q, q->heap[child + 1], q->heap[child]) < 0)
+		{
+			child++;
+		}
+		if(heap_compare(q, q->heap[child], n) >= 0)
+		{
+			break;
+		}
+		heap_place(q, q->heap[child], pos);
+		pos = child;
+	}
+	heap_place(q, n, pos);
+}
+
+//unlinks the node stored at pos, the caller owns the node afterwards
+static Node *heap_delete(priqueue_t *q, int pos)
+{
+	Node *n = q->heap[pos];
+	q->size--;
+	q->sorted_valid = 0;
+	if(pos != q->size)
+	{
+		heap_place(q, q->heap[q->size], pos);
+		if(pos > 0 && heap_compare(q, q->heap[pos], q->heap[(pos - 1) / 2]) < 0)
+		{
+			heap_sift_up(q, pos);
+		}
+		else
+		{
+			heap_sift_down(q, pos);
+		}
+	}
+	return n;
+}
+
+//merge sort of a node array, used to list the heap in priority order
+static void heap_sort_nodes(priqueue_t *q, Node **arr, Node **tmp, int n)
+{
+	int width, i;
+	for(width = 1 ; width < n ; width *= 2)
+	{
+		for(i = 0 ; i < n ; i += 2 * width)
+		{
+			int lo = i;
+			int mid = (i + width < n) ? i + width : n;
+			int hi = (i + 2 * width < n) ? i + 2 * width : n;
+			int a = lo, b = mid, k = lo;
+			while(a < mid && b < hi)
+			{
+				if(heap_compare(q, arr[a], arr[b]) < 0)
+					tmp[k++] = arr[a++];
+				else
+					tmp[k++] = arr[b++];
+			}
+			while(a < mid)
+				tmp[k++] = arr[a++];
+			while(b < hi)
+				tmp[k++] = arr[b++];
+		}
+		Node **swap = arr;
+		arr = tmp;
+		tmp = swap;
+	}
+	//the last pass may have left the result in the scratch buffer
+	if(arr != q->sorted)
+	{
+		for(i = 0 ; i < n ; i++)
+			q->sorted[i] = arr[i];
+	}
+}
+
+//makes sure q->sorted lists the heap nodes in priority order
+static void heap_build_sorted(priqueue_t *q)
+{
+	if(q->sorted_valid)
+	{
+		return;
+	}
+	//the second half of the sorted buffer is scratch space for the merge
+	Node **tmp = q->sorted + q->capacity;
+	int i;
+	for(i = 0 ; i < q->size ; i++)
+	{
+		q->sorted[i] = q->heap[i];
+	}
+	heap_sort_nodes(q, q->sorted, tmp, q->size);
+	q->sorted_valid = 1;
+}
+
+static int heap_insert(priqueue_t *q, Node *newNode)
+{
+	if(q->size == q->capacity)
+	{
+		q->capacity = (q->capacity == 0) ? 16 : q->capacity * 2;
+		q->heap   = realloc(q->heap, q->capacity * sizeof(Node*));
+		q->sorted = realloc(q->sorted, 2 * q->capacity * sizeof(Node*));
+		q->alloc.mallocs += 2;
+	}
+
+	heap_place(q, newNode, q->size);
+	q->size++;
+	q->sorted_valid = 0;
+	heap_sift_up(q, newNode->pos);
+	return newNode->pos;
+}
+
+
+/*
+  Red-black tree backend.
+
+  The nodes form a red-black tree ordered like the heap, comparer first and
+  insertion order second, so offer and removal stay O(log n) however deep the
+  queue is. The linked list of the list backend stays threaded through the
+  nodes in the same order: head is the minimum, and peek, iteration and
+  priqueue_at() walk the list exactly as with the list backend.
+*/
+
+//puts v where u hangs in the tree, v may be NULL
+static void tree_replace(priqueue_t *q, Node *u, Node *v)
+{
+	if(u->parent == NULL)
+		q->root = v;
+	else if(u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if(v != NULL)
+		v->parent = u->parent;
+}
+
+static void tree_rotate_left(priqueue_t *q, Node *x)
+{
+	Node *y = x->right;
+	x->right = y->left;
+	if(y->left != NULL)
+		y->left->parent = x;
+	tree_replace(q, x, y);
+	y->left = x;
+	x->parent = y;
+}
+
+static void tree_rotate_right(priqueue_t *q, Node *x)
+{
+	Node *y = x->left;
+	x->left = y->right;
+	if(y->right != NULL)
+		y->right->parent = x;
+	tree_replace(q, x, y);
+	y->right = x;
+	x->parent = y;
+}
+
+static int tree_is_red(Node *n)
+{
+	return n != NULL && n->red;
+}
+
+static int tree_insert(priqueue_t *q, Node *newNode)
+{
+	//the new node has the highest sequence number, so it goes behind every
+	//node that compares equal to it; the last nodes passed on the way down
+	//are its neighbours in the list
+	Node *parent = NULL, *cur = q->root, *pred = NULL, *succ = NULL;
+	while(cur != NULL)
+	{
+		parent = cur;
+		COUNT(q, traversed, 1);
+		if(heap_compare(q, newNode, cur) < 0)
+		{
+			succ = cur;
+			cur = cur->left;
+		}
+		else
+		{
+			pred = cur;
+			cur = cur->right;
+		}
+	}
+
+	newNode->parent = parent;
+	newNode->left   = NULL;
+	newNode->right  = NULL;
+	newNode->red    = 1;
+	if(parent == NULL)
+		q->root = newNode;
+	else if(parent == succ)
+		parent->left = newNode;
+	else
+		parent->right = newNode;
+
+	newNode->prev = pred;
+	newNode->next = succ;
+	if(pred != NULL)
+		pred->next = newNode;
+	else
+		q->head = newNode;
+	if(succ != NULL)
+		succ->prev = newNode;
+	else
+		q->tail = newNode;
+	q->size++;
+
+	Node *n = newNode;
+	while(tree_is_red(n->parent))
+	{
+		Node *p = n->parent, *g = p->parent;
+		Node *uncle = (p == g->left) ? g->right : g->left;
+		if(tree_is_red(uncle))
+		{
+			p->red = 0;
+			uncle->red = 0;
+			g->red = 1;
+			n = g;
+			continue;
+		}
+		if(p == g->left)
+		{
+			if(n == p->right)
+			{
+				tree_rotate_left(q, p);
+				n = p;
+				p = n->parent;
+			}
+			tree_rotate_right(q, g);
+		}
+		else
+		{
+			if(n == p->left)
+			{
+				tree_rotate_right(q, p);
+				n = p;
+				p = n->parent;
+			}
+			tree_rotate_left(q, g);
+		}
+		p->red = 0;
+		g->red = 1;
+		break;
+	}
+	q->root->red = 0;
+
+	return (pred == NULL) ? 0 : 1;
+}
+
+//takes a node out of the tree, it is still linked into the list afterwards
+static void tree_delete(priqueue_t *q, Node *z)
+{
+	//x moves into the place of the node that leaves its position in the
+	//tree; it may be NULL, so its parent is tracked on the side
+	Node *x, *xParent;
+	int removedRed;
+	if(z->left == NULL || z->right == NULL)
+	{
+		x = (z->left != NULL) ? z->left : z->right;
+		xParent = z->parent;
+		removedRed = z->red;
+		tree_replace(q, z, x);
+	}
+	else
+	{
+		//the in-order successor is simply the next node in the list
+		Node *y = z->next;
+		removedRed = y->red;
+		x = y->right;
+		if(y->parent == z)
+		{
+			xParent = y;
+		}
+		else
+		{
+			xParent = y->parent;
+			tree_replace(q, y, x);
+			y->right = z->right;
+			y->right->parent = y;
+		}
+		tree_replace(q, z, y);
+		y->left = z->left;
+		y->left->parent = y;
+		y->red = z->red;
+	}
+
+	if(removedRed)
+	{
+		return;
+	}
+	while(x != q->root && !tree_is_red(x))
+	{
+		if(x == xParent->left)
+		{
+			Node *w = xParent->right;
+			if(w->red)
+			{
+				w->red = 0;
+				xParent->red = 1;
+				tree_rotate_left(q, xParent);
+				w = xParent->right;
+			}
+			if(!tree_is_red(w->left) && !tree_is_red(w->right))
+			{
+				w->red = 1;
+				x = xParent;
+				xParent = x->parent;
+				continue;
+			}
+			if(!tree_is_red(w->right))
+			{
+				w->left->red = 0;
+				w->red = 1;
+				tree_rotate_right(q, w);
+				w = xParent->right;
+			}
+			w->red = xParent->red;
+			xParent->red = 0;
+			w->right->red = 0;
+			tree_rotate_left(q, xParent);
+		}
+		else
+		{
+			Node *w = xParent->left;
+			if(w->red)
+			{
+				w->red = 0;
+				xParent->red = 1;
+				tree_rotate_right(q, xParent);
+				w = xParent->left;
+			}
+			if(!tree_is_red(w->left) && !tree_is_red(w->right))
+			{
+				w->red = 1;
+				x = xParent;
+				xParent = x->parent;
+				continue;
+			}
+			if(!tree_is_red(w->left))
+			{
+				w->right->red = 0;
+				w->red = 1;
+				tree_rotate_left(q, w);
+				w = xParent->left;
+			}
+			w->red = xParent->red;
+			xParent->red = 0;
+			w->left->red = 0;
+			tree_rotate_right(q, xParent);
+		}
+		x = q->root;
+	}
+	if(x != NULL)
+		x->red = 0;
+}
+
+
+/*
+  Bucket backend, for comparers that order by a small integer key first.
+
+  Every key has a bucket, and the sorted list of the list backend runs
+  through the buckets in key order. A bucket only records its first and
+  last node, and a bitmap records which buckets hold nodes. Inside a bucket
+  the comparer decides, so offering an element that sorts behind the rest of
+  its key, as a new arrival does, is O(1), and so is poll.
+*/
+#define BUCKET_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+//keys outside the buckets go to the first or last one, where the comparer
+//still orders them correctly
+static int bucket_of(priqueue_t *q, Node *n)
+{
+	int b = (q->key != NULL) ? q->key(n->data) : 0;
+	if(b < 0)
+		return 0;
+	if(b >= q->buckets)
+		return q->buckets - 1;
+	return b;
+}
+
+//@return the last node of the nearest bucket below b that holds nodes
+static Node *bucket_last_below(priqueue_t *q, int b)
+{
+	int w = b / BUCKET_WORD_BITS;
+	unsigned long bits = q->bucket_bits[w] & ((1UL << (b % BUCKET_WORD_BITS)) - 1);
+	while(bits == 0)
+	{
+		if(--w < 0)
+			return NULL;
+		bits = q->bucket_bits[w];
+	}
+	int last = w * BUCKET_WORD_BITS + (BUCKET_WORD_BITS - 1 - __builtin_clzl(bits));
+	return q->bucket_last[last];
+}
+
+static void bucket_setup(priqueue_t *q, int(*key)(const void *), int buckets)
+{
+	int words = (buckets + BUCKET_WORD_BITS - 1) / BUCKET_WORD_BITS;
+	q->key = key;
+	q->buckets = buckets;
+	q->bucket_first = calloc(buckets, sizeof(Node*));
+	q->bucket_last = calloc(buckets, sizeof(Node*));
+	q->bucket_bits = calloc(words, sizeof(unsigned long));
+	q->alloc.mallocs += 3;
+}
+
+static int bucket_insert(priqueue_t *q, Node *newNode)
+{
+	//a queue used again after priqueue_destroy() sets its buckets up anew
+	if(q->bucket_first == NULL)
+	{
+		bucket_setup(q, q->key, (q->buckets > 0) ? q->buckets : 1);
+	}
+	int b = bucket_of(q, newNode);
+	newNode->pos = b;
+	Node *pred, *succ;
+
+	if(q->bucket_first[b] == NULL)
+	{
+		pred = bucket_last_below(q, b);
+		q->bucket_first[b] = newNode;
+		q->bucket_last[b] = newNode;
+		q->bucket_bits[b / BUCKET_WORD_BITS] |= 1UL << (b % BUCKET_WORD_BITS);
+	}
+	else if(compare(q, newNode->data, q->bucket_last[b]->data) >= 0)
+	{
+		pred = q->bucket_last[b];
+		q->bucket_last[b] = newNode;
+	}
+	else if(compare(q, newNode->data, q->bucket_first[b]->data) < 0)
+	{
+		pred = q->bucket_first[b]->prev;
+		q->bucket_first[b] = newNode;
+	}
+	else
+	{
+		//behind every node of the bucket it does not sort before
+		pred = q->bucket_first[b];
+		while(compare(q, newNode->data, pred->next->data) >= 0)
+		{
+			COUNT(q, traversed, 1);
+			pred = pred->next;
+		}
+	}
+
+	succ = (pred != NULL) ? pred->next : q->head;
+	newNode->prev = pred;
+	newNode->next = succ;
+	if(pred != NULL)
+		pred->next = newNode;
+	else
+		q->head = newNode;
+	if(succ != NULL)
+		succ->prev = newNode;
+	else
+		q->tail = newNode;
+	q->size++;
+
+	return (pred == NULL) ? 0 : 1;
+}
+
+//takes a node out of its bucket, it is still linked into the list afterwards
+static void bucket_delete(priqueue_t *q, Node *n)
+{
+	int b = n->pos;
+	if(q->bucket_first[b] == n && q->bucket_last[b] == n)
+	{
+		q->bucket_first[b] = NULL;
+		q->bucket_last[b] = NULL;
+		q->bucket_bits[b / BUCKET_WORD_BITS] &= ~(1UL << (b % BUCKET_WORD_BITS));
+	}
+	else if(q->bucket_first[b] == n)
+	{
+		q->bucket_first[b] = n->next;
+	}
+	else if(q->bucket_last[b] == n)
+	{
+		q->bucket_last[b] = n->prev;
+	}
+}
+
+
+//unlinks a node from the linked list, the caller owns the node afterwards
+static void list_unlink(priqueue_t *q, Node *n)
+{
+	if(q->backend == PRIQUEUE_TREE)
+		tree_delete(q, n);
+	else if(q->backend == PRIQUEUE_BUCKET)
+		bucket_delete(q, n);
+	if(n->prev != NULL)
+		n->prev->next = n->next;
+	else
+		q->head = n->next;
+	if(n->next != NULL)
+		n->next->prev = n->prev;
+	else
+		q->tail = n->prev;
+	q->size--;
+}
+
+static int list_insert(priqueue_t *q, Node *newNode);
+
+//stamps a node with the next insertion number and hands it to the backend
+static int insert_node(priqueue_t *q, Node *newNode)
+{
+	newNode->seq  = q->seq++;
+	newNode->next = NULL;
+	newNode->prev = NULL;
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		return heap_insert(q, newNode);
+	}
+	if(q->backend == PRIQUEUE_TREE)
+	{
+		return tree_insert(q, newNode);
+	}
+	if(q->backend == PRIQUEUE_BUCKET)
+	{
+		return bucket_insert(q, newNode);
+	}
+	return list_insert(q, newNode);
+}
+
+
+//puts q in the state of an empty queue that holds no memory, leaving the
+//comparer, the backend and the keys and number of buckets alone
+static void reset_state(priqueue_t *q)
+{
+	q->size = 0;
+	q->head	= NULL;
+	q->tail = NULL;
+	q->root = NULL;
+	q->heap = NULL;
+	q->capacity = 0;
+	q->seq = 0;
+	q->sorted = NULL;
+	q->sorted_valid = 0;
+	q->free_nodes = NULL;
+	q->slabs = NULL;
+	q->alloc.mallocs = 0;
+	q->alloc.nodes = 0;
+	q->alloc.recycled = 0;
+	q->counters.compares = 0;
+	q->counters.traversed = 0;
+	q->bucket_first = NULL;
+	q->bucket_last = NULL;
+	q->bucket_bits = NULL;
+}
+
+
 /**
   Initializes the priqueue_t data structure.
 
@@ -19,9 +686,64 @@
  */
 void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
 {
-	q->size = 0;
-	q->head	= NULL;
+	priqueue_init_backend(q, comparer, PRIQUEUE_LIST);
+}
+
+
+/**
+  Initializes the priqueue_t data structure with a specific storage backend.
+
+  PRIQUEUE_LIST keeps the elements in a sorted linked list: offer is O(n),
+  while walking the queue in order is cheap. PRIQUEUE_HEAP keeps them in an
+  array-backed binary heap: offer and poll are O(log n), while priqueue_at()
+  sorts a snapshot of the heap the first time it is called after a change;
+  priqueue_remove_at() keeps the snapshot up to date.
+  PRIQUEUE_TREE keeps them in a red-black tree threaded with the sorted list:
+  offer and removal are O(log n) and the queue is walked like the list.
+  PRIQUEUE_BUCKET is meant to be set up with priqueue_init_buckets(); set up
+  here it has a single bucket and behaves like the list.
+  All backends keep elements the comparer considers equal in FIFO order.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  See also @ref comparer-page
+  @param backend the storage backend to use
+ */
+void priqueue_init_backend(priqueue_t *q, int(*comparer)(const void *, const void *), priqueue_backend_t backend)
+{
 	q->comparer = comparer;
+	q->backend = backend;
+	q->key = NULL;
+	q->buckets = 0;
+	reset_state(q);
+	if(backend == PRIQUEUE_BUCKET)
+	{
+		bucket_setup(q, NULL, 1);
+	}
+}
+
+
+/**
+  Initializes the priqueue_t data structure with the bucket backend.
+
+  The comparer has to order elements by key first: key(a) < key(b) must mean
+  that a comes before b. Elements with a key below 0 share the first bucket
+  and elements with a key of buckets or more share the last one, ordered
+  among themselves by the comparer. Offer and poll are O(1) as long as an
+  element sorts behind the elements of its bucket, as FIFO offers do, and
+  the queue is walked like the list.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  See also @ref comparer-page
+  @param key a function pointer that returns the bucket of an element
+  @param buckets the number of buckets
+ */
+void priqueue_init_buckets(priqueue_t *q, int(*comparer)(const void *, const void *), int(*key)(const void *), int buckets)
+{
+	priqueue_init_backend(q, comparer, PRIQUEUE_LIST);
+	q->backend = PRIQUEUE_BUCKET;
+	bucket_setup(q, key, (buckets > 0) ? buckets : 1);
 }
 
 
@@ -31,14 +753,102 @@ void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
   @param q a pointer to an instance of the priqueue_t data structure
   @param ptr a pointer to the data to be inserted into the priority queue
   @return The zero-based index where ptr is stored in the priority queue, where 0 indicates that ptr was stored at the front of the priority queue.
+  With the heap backend the rank is not tracked: 0 still means ptr is at the
+  front, any other value is its slot in the heap. The tree and bucket
+  backends do not track it either and return 1 for any place behind the front.
  */
 int priqueue_offer(priqueue_t *q, void *ptr)
 {
 	//create a new node with the value to be inserted into the queueueueue
-	Node* newNode = malloc(sizeof(Node));
+	Node* newNode = node_get(q);
 	newNode->data = ptr;
-	newNode->next = NULL;
 
+	return insert_node(q, newNode);
+}
+
+
+/**
+  Insert the specified element into this priority queue and return a handle
+  to it.
+
+  The handle stays valid until the element leaves the queue (poll, remove,
+  remove_at or priqueue_remove_handle()), and lets the caller remove or
+  re-prioritize the element without searching for it.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a handle to the element inside the queue
+ */
+priqueue_handle_t priqueue_offer_handle(priqueue_t *q, void *ptr)
+{
+	Node* newNode = node_get(q);
+	newNode->data = ptr;
+	insert_node(q, newNode);
+	return newNode;
+}
+
+
+/**
+  Removes the element referenced by a handle from the queue.
+
+  O(1) with the list and bucket backends and O(log n) with the heap and tree
+  backends.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle() for an element
+  that is still in q
+  @return the element removed from the queue
+ */
+void *priqueue_remove_handle(priqueue_t *q, priqueue_handle_t handle)
+{
+	void *data = handle->data;
+	if(q->backend == PRIQUEUE_HEAP)
+		heap_delete(q, handle->pos);
+	else
+		list_unlink(q, handle);
+	node_put(q, handle);
+	return data;
+}
+
+
+/**
+  Moves the element referenced by a handle to its new place after the caller
+  changed the fields the comparer looks at.
+
+  The element is ordered as if it had just been offered: it goes behind any
+  elements that compare equal to it, exactly like removing and re-offering it.
+  The handle stays valid. O(log n) with the heap and tree backends and O(n)
+  with the list backend. The bucket backend costs O(1) if the element sorts
+  behind its new bucket and up to the size of the bucket otherwise.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle() for an element
+  that is still in q
+ */
+void priqueue_update(priqueue_t *q, priqueue_handle_t handle)
+{
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		handle->seq = q->seq++;
+		q->sorted_valid = 0;
+		heap_sift_up(q, handle->pos);
+		heap_sift_down(q, handle->pos);
+	}
+	else
+	{
+		list_unlink(q, handle);
+		insert_node(q, handle);
+	}
+}
+
+
+/**
+  Linked list backend of priqueue_offer().
+
+  @return the zero-based index where newNode was linked in
+ */
+static int list_insert(priqueue_t *q, Node *newNode)
+{
 	//Insert into the linked list
 
 	//Case 1:
@@ -46,10 +856,23 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 	if(q->size == 0)
 	{
 		q->head = newNode;
+		q->tail = newNode;
 		q->size++;
 		return 0;
 	}
 
+	//Case 1b:
+	//the new node sorts after the tail, as every FIFO offer does,
+	//so it is appended without walking the list
+	if(compare(q, newNode->data, q->tail->data) >= 0)
+	{
+		newNode->prev = q->tail;
+		q->tail->next = newNode;
+		q->tail = newNode;
+		q->size++;
+		return q->size - 1;
+	}
+
 	//Case 2:
 	//Find where this new node should go
 	//This means finding a Node with an inner value that has a lower priority
@@ -62,9 +885,10 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 		//comparer returns negative when the first argument is less than the second.
 		//So this if tests whether the new node has higher priority (smaller value)
 		//than the current head
-		if(q->comparer(newNode->data, q->head->data) < 0)
+		if(compare(q, newNode->data, q->head->data) < 0)
 		{
 			newNode->next = q->head;
+			q->head->prev = newNode;
 			q->head = newNode;
 			q->size++;
 			return 0;
@@ -86,10 +910,13 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 			// we have size of the list
 			for(i = 0 ; i < q->size-1 ; i++)
 			{
-				if(q->comparer(newNode->data, tempNext->data) < 0)
+				COUNT(q, traversed, 1);
+				if(compare(q, newNode->data, tempNext->data) < 0)
 				{
 					temp->next = newNode;
+					newNode->prev = temp;
 					newNode->next = tempNext;
+					tempNext->prev = newNode;
 					q->size++;
 					return i+1;
 				}
@@ -102,6 +929,8 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 			//if the entire for loop was executed, then this is going on the back
 			//also note, temp will point to the last element in the list
 			temp->next = newNode;
+			newNode->prev = temp;
+			q->tail = newNode;
 			q->size++;
 			return q->size - 1;
 		}
@@ -126,6 +955,10 @@ void *priqueue_peek(priqueue_t *q)
 	{
 		return NULL;
 	}
+	else if(q->backend == PRIQUEUE_HEAP)
+	{
+		return q->heap[0]->data;
+	}
 	else
 	{
 		return q->head->data;
@@ -147,13 +980,19 @@ void *priqueue_poll(priqueue_t *q)
 	{
 		return NULL;
 	}
+	else if(q->backend == PRIQUEUE_HEAP)
+	{
+		Node* temp = heap_delete(q, 0);
+		void* ret = temp->data;
+		node_put(q, temp);
+		return ret;
+	}
 	else
 	{
-		Node* temp = q->head->next;
-		void* ret = q->head->data;
-		free(q->head);
-		q->head = temp;
-		q->size--;
+		Node* temp = q->head;
+		void* ret = temp->data;
+		list_unlink(q, temp);
+		node_put(q, temp);
 		return ret;
 	}
 }
@@ -178,9 +1017,15 @@ void *priqueue_at(priqueue_t *q, int index)
 	{
 		return NULL;
 	}
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		heap_build_sorted(q);
+		return q->sorted[index]->data;
+	}
 
 	Node* temp = q->head;
 	int i;
+	COUNT(q, traversed, index);
 	for(i = 0 ; i < index ; i++)
 	{
 		temp = temp->next;
@@ -204,31 +1049,60 @@ int priqueue_remove(priqueue_t *q, void *ptr)
 	{
 		return 0;
 	}
-	Node* temp1 = q->head;
-	Node* temp2;
 
 	int ret = 0;
 
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		//compact the array without the matches, then restore the heap order
+		int i, kept = 0;
+		for(i = 0 ; i < q->size ; i++)
+		{
+			if(q->heap[i]->data == ptr)
+			{
+				node_put(q, q->heap[i]);
+				ret++;
+			}
+			else
+			{
+				heap_place(q, q->heap[i], kept++);
+			}
+		}
+		q->size = kept;
+		q->sorted_valid = 0;
+		for(i = q->size / 2 - 1 ; i >= 0 ; i--)
+		{
+			heap_sift_down(q, i);
+		}
+		return ret;
+	}
+
+	Node* temp1 = q->head;
+	Node* temp2;
+
 	//need to worry about the head being the value
 	//and if that's the case, need to worry about the new head being the value.
 	while(temp1 != NULL && temp1->data == ptr)
 	{
-			q->head = temp1->next;
-			free(temp1);
-			q->size--;
+			list_unlink(q, temp1);
+			node_put(q, temp1);
 			ret++;
 			temp1 = q->head;
 	}
 
+	if(temp1 == NULL)
+	{
+		return ret;
+	}
+
 	//Now we check the values in the rest of the list
 	temp2 = temp1->next;
 	while(temp2 != NULL)
 	{
 		if(temp2->data == ptr)
 		{
-			temp1->next = temp2->next;
-			free(temp2);
-			q->size--;
+			list_unlink(q, temp2);
+			node_put(q, temp2);
 			ret++;
 			temp2 = temp1->next;
 		}
@@ -261,14 +1135,25 @@ void *priqueue_remove_at(priqueue_t *q, int index)
 	{
 		return NULL;
 	}
-	Node* temp1 = q->head;
 	void* data;
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		heap_build_sorted(q);
+		Node* temp = heap_delete(q, q->sorted[index]->pos);
+		//the other nodes keep their order, so the snapshot stays valid once
+		//the gap is closed and a run of removals sorts only once
+		memmove(&q->sorted[index], &q->sorted[index + 1], (q->size - index) * sizeof(Node*));
+		q->sorted_valid = 1;
+		data = temp->data;
+		node_put(q, temp);
+		return data;
+	}
+	Node* temp1 = q->head;
 	if(index == 0)
 	{
-		q->head = temp1->next;
 		data = temp1->data;
-		free(temp1);
-		q->size--;
+		list_unlink(q, temp1);
+		node_put(q, temp1);
 		return data;
 	}
 	int i;
@@ -278,10 +1163,9 @@ void *priqueue_remove_at(priqueue_t *q, int index)
 		temp1 = temp1->next;
 		temp2 = temp2->next;
 	}
-	temp1->next = temp2->next;
 	data = temp2->data;
-	free(temp2);
-	q->size--;
+	list_unlink(q, temp2);
+	node_put(q, temp2);
 
 	return data;
 }
@@ -299,19 +1183,152 @@ int priqueue_size(priqueue_t *q)
 }
 
 
+//moves the iterator onto a node, or past the end when n is NULL
+static void *iter_land(priqueue_iter_t *it, Node *n)
+{
+	it->node = n;
+	if(n == NULL)
+	{
+		it->next = NULL;
+		return NULL;
+	}
+	it->next = n->next;
+	return n->data;
+}
+
+
+/**
+  Starts a walk over the queue in priority order, the same order
+  priqueue_at() numbers the elements in.
+
+  A full walk with priqueue_iter_next() costs O(n) with the list, tree and
+  bucket backends and O(n log n) with the heap backend, instead of the O(n^2) of calling
+  priqueue_at() for every index. The queue must not be changed during the
+  walk other than through priqueue_iter_remove().
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param it the iterator to set up
+  @return the head of the queue
+  @return NULL if the queue is empty
+ */
+void *priqueue_iter_begin(priqueue_t *q, priqueue_iter_t *it)
+{
+	it->q = q;
+	it->index = 0;
+	it->count = q->size;
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		if(q->size == 0)
+		{
+			return iter_land(it, NULL);
+		}
+		heap_build_sorted(q);
+		return iter_land(it, q->sorted[0]);
+	}
+	return iter_land(it, q->head);
+}
+
+
+/**
+  Advances the iterator to the next element.
+
+  @param it an iterator set up by priqueue_iter_begin()
+  @return the next element of the queue
+  @return NULL once every element has been visited
+ */
+void *priqueue_iter_next(priqueue_iter_t *it)
+{
+	if(it->q->backend == PRIQUEUE_HEAP)
+	{
+		it->index++;
+		if(it->index >= it->count)
+		{
+			return iter_land(it, NULL);
+		}
+		return iter_land(it, it->q->sorted[it->index]);
+	}
+	return iter_land(it, it->next);
+}
+
+
+/**
+  Removes the element the iterator is on from the queue. The following call
+  to priqueue_iter_next() returns the element that came after it.
+
+  @param it an iterator set up by priqueue_iter_begin()
+  @return the element removed from the queue
+  @return NULL if the iterator is not on an element
+ */
+void *priqueue_iter_remove(priqueue_iter_t *it)
+{
+	Node *n = it->node;
+	if(n == NULL)
+	{
+		return NULL;
+	}
+	//the snapshot stays usable for the rest of the walk: removed nodes are
+	//only skipped, and nothing reorders it until the next priqueue_at()
+	void *data = priqueue_remove_handle(it->q, n);
+	it->node = NULL;
+	return data;
+}
+
+
+/**
+  Reports how much allocation work the queue has done so far.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param stats filled in with the allocation counters of q
+ */
+void priqueue_alloc_stats(priqueue_t *q, priqueue_alloc_stats_t *stats)
+{
+	*stats = q->alloc;
+}
+
+
+/**
+  Reports the hot-path counters of the queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param counters filled in with the counters of q
+  @return 1 if the counters are compiled in
+  @return 0 if they are not, and every counter is 0
+ */
+int priqueue_counters(priqueue_t *q, priqueue_counters_t *counters)
+{
+	*counters = q->counters;
+#ifdef PRIQUEUE_COUNTERS
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+
 /**
   Destroys and frees all the memory associated with q.
 
+  q is left an empty queue with the same comparer and backend, as if just
+  initialized, so it is safe to use again.
+
   @param q a pointer to an instance of the priqueue_t data structure
  */
 void priqueue_destroy(priqueue_t *q)
 {
-	Node* temp1 = q->head;
-	Node* temp2 = q->head;
+	free(q->heap);
+	free(q->sorted);
+	free(q->bucket_first);
+	free(q->bucket_last);
+	free(q->bucket_bits);
+
+	//every node, queued or free, lives in one of the slabs
+	NodeSlab* temp1 = q->slabs;
+	NodeSlab* temp2 = q->slabs;
 	while(temp1 != NULL)
 	{
 		temp1 = temp1->next;
 		free(temp2);
 		temp2 = temp1;
 	}
+	reset_state(q);
 }
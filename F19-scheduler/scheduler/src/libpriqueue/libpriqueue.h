@@ -4,14 +4,65 @@
 #ifndef LIBPRIQUEUE_H_
 #define LIBPRIQUEUE_H_
 
+/**
+  Storage backends for a priqueue_t, chosen when the queue is initialized
+*/
+typedef enum {PRIQUEUE_LIST = 0, PRIQUEUE_HEAP, PRIQUEUE_TREE, PRIQUEUE_BUCKET} priqueue_backend_t;
+
 /**
 	Node to implement a linked list inside the priority queue
+	(or a slot of the binary heap when the heap backend is used)
 */
 typedef struct _Node {
     void* data;
     struct _Node* next;
+    struct _Node* prev;
+    unsigned long seq;
+    int pos;
+    //tree backend: links of the red-black tree, the list above stays
+    //threaded through the nodes in order
+    struct _Node* left;
+    struct _Node* right;
+    struct _Node* parent;
+    int red;
 } Node;
 
+/**
+  Stable reference to an element inside a priqueue_t, see priqueue_offer_handle()
+*/
+typedef Node* priqueue_handle_t;
+
+/**
+  Block of nodes allocated at once by the node pool of a priqueue_t
+*/
+typedef struct _NodeSlab {
+	struct _NodeSlab* next;
+	int count;
+	Node nodes[];
+} NodeSlab;
+
+/**
+  Allocation counters of a priqueue_t.
+  Once a queue has reached its largest size, offering and removing
+  elements only recycles nodes and mallocs stops growing.
+*/
+typedef struct _priqueue_alloc_stats_t {
+	long mallocs;   //calls to malloc/realloc made by the queue
+	long nodes;     //nodes handed out by the pool
+	long recycled;  //nodes that were reused from the free list
+} priqueue_alloc_stats_t;
+
+/**
+  Hot-path counters of a priqueue_t. They are only counted when the library
+  is built with PRIQUEUE_COUNTERS defined (make COUNTERS=1); otherwise the
+  counting is compiled out and they stay 0.
+*/
+typedef struct _priqueue_counters_t {
+	long compares;   //calls to the comparer
+	long traversed;  //nodes walked past to find a place or an index, heap
+	                 //levels for the heap backend
+} priqueue_counters_t;
+
 /**
   Priqueue Data Structure
 */
@@ -19,14 +70,59 @@ typedef struct _priqueue_t
 {
 	int size;
 	Node* head;
+	Node* tail;     //last node of the list backend, for O(1) appends
+	Node* root;     //root of the red-black tree of the tree backend
 	int (*comparer)(const void*, const void*);
+	priqueue_backend_t backend;
+
+	//heap backend: array of nodes ordered as a binary min-heap
+	Node** heap;
+	int capacity;
+	//insertion counter, breaks comparer ties so equal elements stay FIFO
+	unsigned long seq;
+	//priority-ordered copy of the heap, rebuilt lazily for priqueue_at()
+	//and kept up to date by priqueue_remove_at()
+	Node** sorted;
+	int sorted_valid;
+
+	//bucket backend: the first and last node of every bucket, and one bit
+	//per bucket that holds nodes
+	int (*key)(const void*);
+	int buckets;
+	Node** bucket_first;
+	Node** bucket_last;
+	unsigned long* bucket_bits;
+
+	//node pool: nodes are carved out of slabs and recycled through free_nodes,
+	//every slab is released at once by priqueue_destroy()
+	Node* free_nodes;
+	NodeSlab* slabs;
+	priqueue_alloc_stats_t alloc;
+	priqueue_counters_t counters;
 } priqueue_t;
 
+/**
+  Cursor walking a priqueue_t from the head in priority order
+*/
+typedef struct _priqueue_iter_t
+{
+	priqueue_t* q;
+	Node* node;    //current element, NULL once it has been removed
+	Node* next;    //element after the current one (list backend)
+	int index;     //position of the current element in the snapshot (heap backend)
+	int count;     //number of elements in the snapshot (heap backend)
+} priqueue_iter_t;
+
 
 
 void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void *));
+void   priqueue_init_backend(priqueue_t *q, int(*comparer)(const void *, const void *), priqueue_backend_t backend);
+void   priqueue_init_buckets(priqueue_t *q, int(*comparer)(const void *, const void *), int(*key)(const void *), int buckets);
 
 int    priqueue_offer    (priqueue_t *q, void *ptr);
+priqueue_handle_t priqueue_offer_handle(priqueue_t *q, void *ptr);
+void * priqueue_remove_handle(priqueue_t *q, priqueue_handle_t handle);
+void   priqueue_update   (priqueue_t *q, priqueue_handle_t handle);
 void * priqueue_peek     (priqueue_t *q);
 void * priqueue_poll     (priqueue_t *q);
 void * priqueue_at       (priqueue_t *q, int index);
@@ -34,6 +130,13 @@ int    priqueue_remove   (priqueue_t *q, void *ptr);
 void * priqueue_remove_at(priqueue_t *q, int index);
 int    priqueue_size     (priqueue_t *q);
 
+void * priqueue_iter_begin (priqueue_t *q, priqueue_iter_t *it);
+void * priqueue_iter_next  (priqueue_iter_t *it);
+void * priqueue_iter_remove(priqueue_iter_t *it);
+
+void   priqueue_alloc_stats(priqueue_t *q, priqueue_alloc_stats_t *stats);
+int    priqueue_counters (priqueue_t *q, priqueue_counters_t *counters);
+
 void   priqueue_destroy  (priqueue_t *q);
 
 #endif /* LIBPQUEUE_H_ */
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "libscheduler.h"
 #include "../libpriqueue/libpriqueue.h"
@@ -27,18 +28,48 @@ typedef struct _job_t
 	int running_time;
 	int remaining_time;
 	int last_start_time;
+	//MLFQ: level the job waits or runs on, and the part of that level's
+	//quantum it has used up
+	int level;
+	int slice_used;
+	//CFS: weight from the priority used as a nice value, and the run time
+	//so far scaled by that weight. STRIDE and LOTTERY take the weight as the
+	//job's tickets, and STRIDE the virtual runtime as its pass
+	int weight;
+	long long vruntime;
+	//LOTTERY: the job's slot in the ticket tree while it waits
+	int ticketSlot;
+	//the target CPU time per ticket owed before the job arrived
+	double shareStart;
+	//the core whose run queue the job waits in (-1 until it is placed),
+	//and the core it last ran on (-1 before it first runs)
+	int queueCore;
+	int lastCore;
+	//PPRI, PSJF and PEDF: the job's place in the queue of victims while it runs
+	priqueue_handle_t victimHandle;
+	//the time the job is due, LLONG_MAX if it has no deadline
+	long long deadline;
+	//for the job sink: the time the job first got a core (-1 before), the
+	//times a core was taken from it before it finished, and the times it was
+	//put on a different core than it last ran on
+	int first_start;
+	int preemptions;
+	int migrations;
 
 } job_t;
 
-float avg_waiting_time;
-float avg_response_time;
-float avg_turnaround_time;
-int totalJobs;
+//the scheduler behind the original, context-free API
+static scheduler_t default_scheduler;
 
-scheme_t currScheme;
-int numCores;
+//the hot-path counters cost nothing unless they are compiled in
+#ifdef SCHEDULER_COUNTERS
+#define COUNT(statement) statement
+#else
+#define COUNT(statement)
+#endif
 
-priqueue_t Queue;
+//one bit per idle core, so the lowest idle core is a find-first-set away
+#define CORE_WORD_BITS (8 * (int)sizeof(unsigned long))
 
 int compareArrival(const void * a, const void * b)
 {
@@ -68,49 +99,1020 @@ int comparePriority(const void * a, const void * b)
 	}
 	return(sol);
 }
+//the priority schemes keep one bucket per priority, priorities of the traces
+//are small integers; larger ones share the last bucket
+#define PRIORITY_BUCKETS 140
+int priorityKey(const void * a)
+{
+	const job_t *p = a;
+	return p->priority;
+}
+int compareDeadline(const void * a, const void * b)
+{
+	const job_t *p = a, *q = b;
+	//jobs without a deadline come last, in arrival order
+	if(p->deadline != q->deadline)
+	{
+		return (p->deadline < q->deadline) ? -1 : 1;
+	}
+	return(p->arrival_time - q->arrival_time);
+}
+int compareVruntime(const void * a, const void * b)
+{
+	const job_t *p = a, *q = b;
+	//ties keep their arrival order in the queue
+	if(p->vruntime < q->vruntime)
+		return -1;
+	return (p->vruntime > q->vruntime) ? 1 : 0;
+}
+//the preemption victims come first: under PPRI the running job with the
+//largest priority value, under PSJF the one with the most remaining time and
+//under PEDF the one due last, then the latest arrival; the lowest core wins
+//what is left of a tie, as it did when the victim was found by scanning the
+//cores in order
+int compareVictimPriority(const void * a, const void * b)
+{
+	const job_t *p = a, *q = b;
+	if(p->priority != q->priority)
+	{
+		return (p->priority > q->priority) ? -1 : 1;
+	}
+	return p->coreNum - q->coreNum;
+}
+int compareVictimBurst(const void * a, const void * b)
+{
+	const job_t *p = a, *q = b;
+	if(p->remaining_time != q->remaining_time)
+	{
+		return (p->remaining_time > q->remaining_time) ? -1 : 1;
+	}
+	if(p->arrival_time != q->arrival_time)
+	{
+		return (p->arrival_time > q->arrival_time) ? -1 : 1;
+	}
+	return p->coreNum - q->coreNum;
+}
+int compareVictimDeadline(const void * a, const void * b)
+{
+	const job_t *p = a, *q = b;
+	if(p->deadline != q->deadline)
+	{
+		return (p->deadline > q->deadline) ? -1 : 1;
+	}
+	if(p->arrival_time != q->arrival_time)
+	{
+		return (p->arrival_time > q->arrival_time) ? -1 : 1;
+	}
+	return p->coreNum - q->coreNum;
+}
 int compareRR(const void * a, const void * b)
 {
-	//we don't want to compare, just put the value at the back of the queue;
+	//we don't want to compare, just put the value at the back of the queue;
+	return 0;
+}
+
+
+/**
+  Records that core_id is now running job, or is idle when job is NULL.
+  Under PPRI, PSJF and PEDF the job that leaves the core leaves the victims too.
+*/
+static void set_core(scheduler_t *s, int core_id, job_t *job)
+{
+	unsigned long *word = &s->idleCores[core_id / CORE_WORD_BITS];
+	unsigned long bit   = 1UL << (core_id % CORE_WORD_BITS);
+
+	if(s->currScheme == PPRI || s->currScheme == PSJF || s->currScheme == PEDF)
+	{
+		if(s->coreJobs[core_id] != NULL)
+		{
+			priqueue_remove_handle(&s->Victims, s->coreJobs[core_id]->victimHandle);
+		}
+		if(job != NULL)
+		{
+			//the victim order looks at the core
+			job->coreNum = core_id;
+			job->victimHandle = priqueue_offer_handle(&s->Victims, job);
+		}
+	}
+
+	if(job == NULL && !(*word & bit))
+	{
+		*word |= bit;
+		s->numIdle++;
+	}
+	else if(job != NULL && (*word & bit))
+	{
+		*word &= ~bit;
+		s->numIdle--;
+	}
+	s->coreJobs[core_id] = job;
+}
+
+/**
+  @return the lowest id of an idle core
+  @return -1 if every core is busy
+*/
+static int first_idle_core(scheduler_t *s)
+{
+	int w;
+	if(s->numIdle == 0)
+	{
+		return -1;
+	}
+	for(w = 0 ; w * CORE_WORD_BITS < s->numCores ; w++)
+	{
+		if(s->idleCores[w] != 0)
+		{
+			return w * CORE_WORD_BITS + __builtin_ctzl(s->idleCores[w]);
+		}
+	}
+	return -1;
+}
+
+
+/**
+  @return the quantum of an MLFQ level, doubling from the top level down
+*/
+static int mlfq_quantum(scheduler_t *s, int level)
+{
+	if(level >= 31 || s->params.mlfq_quantum > (INT_MAX >> level))
+	{
+		return INT_MAX;
+	}
+	return s->params.mlfq_quantum << level;
+}
+
+/*
+  CFS weights of the nice values -20 to 19, the table of the Linux scheduler.
+  Every step of nice changes the share of a job by about 10%.
+*/
+#define CFS_NICE_0_WEIGHT 1024
+static const int cfs_nice_weights[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+/**
+  @return the CFS weight of a job, its priority taken as a nice value
+*/
+static int cfs_weight(int priority)
+{
+	if(priority < -20)
+		priority = -20;
+	if(priority > 19)
+		priority = 19;
+	return cfs_nice_weights[priority + 20];
+}
+
+/**
+  @return how far a job's virtual runtime moves when it runs for time units.
+  Virtual runtime counts in 1/1024ths of a time unit of a nice 0 job, so the
+  heaviest jobs still move by a few steps per time unit.
+*/
+static long long cfs_vruntime_delta(job_t *job, int time)
+{
+	return (long long)time * CFS_NICE_0_WEIGHT * 1024 / job->weight;
+}
+
+/**
+  @return the CFS time slice of a job that is put on a core: its weighted
+  share of the period, where the period is the target latency stretched so
+  that every runnable job of a core gets at least the minimum granularity
+*/
+static int cfs_slice(scheduler_t *s, job_t *job)
+{
+	long long granularity = s->params.cfs_granularity;
+	long long period = s->params.cfs_latency;
+	long long perCore = (s->numRunnable + s->numCores - 1) / s->numCores;
+	if(perCore * granularity > period)
+	{
+		period = perCore * granularity;
+	}
+
+	long long slice = period * job->weight * s->numCores / s->runnableWeight;
+	if(slice < granularity)
+	{
+		slice = granularity;
+	}
+	if(slice > period)
+	{
+		slice = period;
+	}
+	return (slice < INT_MAX) ? (int)slice : INT_MAX;
+}
+
+/**
+  @return the histogram bucket of a value that is not negative: values below
+  128 have their own, larger ones fall in 64 buckets per power of two by
+  their top 7 bits
+*/
+static int histogram_index(int value)
+{
+	if(value < 128)
+	{
+		return value;
+	}
+	int shift = 31 - __builtin_clz(value) - 6;
+	return 128 + (shift - 1) * 64 + ((value >> shift) - 64);
+}
+
+/**
+  @return the smallest value that falls in a histogram bucket
+*/
+static long long histogram_lower(int index)
+{
+	if(index < 128)
+	{
+		return index;
+	}
+	int shift    = (index - 128) / 64 + 1;
+	int mantissa = (index - 128) % 64 + 64;
+	return (long long)mantissa << shift;
+}
+
+/**
+  @return the largest value that falls in a histogram bucket
+*/
+static long long histogram_upper(int index)
+{
+	if(index < 128)
+	{
+		return index;
+	}
+	int shift    = (index - 128) / 64 + 1;
+	int mantissa = (index - 128) % 64 + 64;
+	return ((long long)(mantissa + 1) << shift) - 1;
+}
+
+/**
+  Adds a value of a finished job to the histogram of its metric.
+*/
+static void histogram_record(scheduler_histogram_t *h, int value)
+{
+	if(value >= 0)
+	{
+		h->buckets[histogram_index(value)]++;
+	}
+	else
+	{
+		h->negative[histogram_index((value > -INT_MAX) ? -value : INT_MAX)]++;
+	}
+	if(h->count == 0 || value > h->max)
+	{
+		h->max = value;
+	}
+	h->count++;
+}
+
+/**
+  Adds the lateness of a finished job that had a deadline to the deadline
+  statistics.
+*/
+static void record_lateness(scheduler_t *s, long long lateness)
+{
+	scheduler_deadline_stats_t *d = &s->deadlines;
+	if(d->jobs == 0 || lateness < d->min_lateness)
+	{
+		d->min_lateness = lateness;
+	}
+	if(d->jobs == 0 || lateness > d->max_lateness)
+	{
+		d->max_lateness = lateness;
+	}
+	d->jobs++;
+	d->total_lateness += lateness;
+	if(lateness > 0)
+	{
+		int bucket = 63 - __builtin_clzll(lateness);
+		if(bucket >= SCHEDULER_TARDINESS_BUCKETS)
+		{
+			bucket = SCHEDULER_TARDINESS_BUCKETS - 1;
+		}
+		d->misses++;
+		d->tardiness[bucket]++;
+	}
+}
+
+/**
+  PPRI, PSJF and PEDF: tells whether a new job takes the core of the victim
+  at the head of the victims.
+*/
+static int preempts(scheduler_t *s, job_t *job, job_t *victim)
+{
+	if(s->currScheme == PPRI)
+	{
+		return victim->priority > job->priority;
+	}
+	if(s->currScheme == PSJF)
+	{
+		return victim->remaining_time > job->remaining_time;
+	}
+	return victim->deadline > job->deadline;
+}
+
+/**
+  Records that a job was put on a core at time, and makes the core's run
+  queue the one the job goes back to. Whatever put it there, under every
+  scheme, the first time it runs is its start time for the response time.
+*/
+static void core_dispatched(scheduler_t *s, int core_id, job_t *job, int time)
+{
+	scheduler_core_stats_t *stats = &s->coreStats[core_id];
+	stats->dispatches++;
+	if(job->start_time < 0)
+	{
+		job->start_time = time;
+	}
+	if(job->first_start < 0)
+	{
+		job->first_start = time;
+	}
+	if(job->lastCore >= 0 && job->lastCore != core_id)
+	{
+		stats->migrations++;
+		job->migrations++;
+	}
+#ifdef SCHEDULER_COUNTERS
+	if(s->lastJobs[core_id] != job->job_number)
+	{
+		stats->context_switches++;
+		s->lastJobs[core_id] = job->job_number;
+	}
+#endif
+	job->lastCore  = core_id;
+	job->queueCore = core_id;
+}
+
+/**
+  Per-core run queues: picks the core whose queue a new job waits in.
+*/
+static int place_core(scheduler_t *s)
+{
+	if(s->params.rq_place == RQ_PLACE_ROUND_ROBIN)
+	{
+		int core_id = s->nextPlace;
+		s->nextPlace = (s->nextPlace + 1) % s->numCores;
+		return core_id;
+	}
+
+	int i, best = 0;
+	for(i = 1 ; i < s->numCores ; i++)
+	{
+		if(priqueue_size(&s->coreQueues[i]) < priqueue_size(&s->coreQueues[best]))
+		{
+			best = i;
+		}
+	}
+	return best;
+}
+
+/**
+  Per-core run queues: takes a job from the queue of another core for a
+  core whose own queue is empty.
+
+  @return NULL if the policy finds nothing to take
+*/
+static job_t *steal_job(scheduler_t *s, int core_id)
+{
+	int i, from = -1;
+	if(s->params.rq_steal == RQ_STEAL_BUSIEST)
+	{
+		for(i = 0 ; i < s->numCores ; i++)
+		{
+			if(i != core_id && priqueue_size(&s->coreQueues[i]) > 0 &&
+			   (from < 0 || priqueue_size(&s->coreQueues[i]) > priqueue_size(&s->coreQueues[from])))
+			{
+				from = i;
+			}
+		}
+	}
+	else if(s->params.rq_steal == RQ_STEAL_NEIGHBOR)
+	{
+		//the first core after this one, going round, that has jobs waiting
+		for(i = 1 ; i < s->numCores ; i++)
+		{
+			int peer = (core_id + i) % s->numCores;
+			if(priqueue_size(&s->coreQueues[peer]) > 0)
+			{
+				from = peer;
+				break;
+			}
+		}
+	}
+
+	if(from < 0)
+	{
+		return NULL;
+	}
+	s->coreStats[core_id].steals++;
+	return priqueue_poll(&s->coreQueues[from]);
+}
+
+/**
+  LOTTERY: the next random number of the draws, from splitmix64 so a seed
+  gives the same draws on every platform.
+*/
+static unsigned long long lottery_next(scheduler_t *s)
+{
+	unsigned long long z = (s->lotteryState += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+  LOTTERY: adds delta tickets to a slot of the Fenwick tree.
+*/
+static void ticket_add(scheduler_t *s, int slot, long long delta)
+{
+	int i;
+	for(i = slot + 1 ; i <= s->ticketSlots ; i += i & -i)
+	{
+		s->ticketTree[i] += delta;
+	}
+}
+
+/**
+  LOTTERY: doubles the slots, keeping their number a power of two, and
+  rebuilds the Fenwick tree over them in O(n).
+*/
+static void lottery_grow(scheduler_t *s)
+{
+	int i, slots = (s->ticketSlots > 0) ? 2 * s->ticketSlots : 64;
+	s->ticketJobs  = realloc(s->ticketJobs, slots * sizeof(job_t*));
+	s->freeSlots   = realloc(s->freeSlots, slots * sizeof(int));
+	free(s->ticketTree);
+	s->ticketTree  = calloc(slots + 1, sizeof(long long));
+	s->ticketSlots = slots;
+	for(i = 1 ; i <= slots ; i++)
+	{
+		if(i <= s->usedSlots && s->ticketJobs[i - 1] != NULL)
+		{
+			s->ticketTree[i] += s->ticketJobs[i - 1]->weight;
+		}
+		int parent = i + (i & -i);
+		if(parent <= slots)
+		{
+			s->ticketTree[parent] += s->ticketTree[i];
+		}
+	}
+}
+
+/**
+  LOTTERY: gives a waiting job a slot and enters its tickets in the draws.
+*/
+static void lottery_enter(scheduler_t *s, job_t *job)
+{
+	int slot;
+	if(s->numFree > 0)
+	{
+		slot = s->freeSlots[--s->numFree];
+	}
+	else
+	{
+		if(s->usedSlots == s->ticketSlots)
+		{
+			lottery_grow(s);
+		}
+		slot = s->usedSlots++;
+	}
+	job->ticketSlot = slot;
+	s->ticketJobs[slot] = job;
+	s->waitingTickets += job->weight;
+	ticket_add(s, slot, job->weight);
+}
+
+/**
+  LOTTERY: draws a ticket of the waiting jobs and takes its holder out of
+  the draws. The winner is found by walking down the Fenwick tree.
+
+  @return NULL if no job is waiting
+*/
+static job_t *lottery_draw(scheduler_t *s)
+{
+	if(s->waitingTickets == 0)
+	{
+		return NULL;
+	}
+	long long ticket = lottery_next(s) % s->waitingTickets;
+	int slot = 0, step;
+	for(step = s->ticketSlots ; step > 0 ; step >>= 1)
+	{
+		//slot counts the slots whose tickets all lie before the one drawn
+		if(slot + step <= s->ticketSlots && s->ticketTree[slot + step] <= ticket)
+		{
+			slot += step;
+			ticket -= s->ticketTree[slot];
+		}
+	}
+
+	job_t *job = s->ticketJobs[slot];
+	ticket_add(s, slot, -job->weight);
+	s->waitingTickets -= job->weight;
+	s->ticketJobs[slot] = NULL;
+	s->freeSlots[s->numFree++] = slot;
+	return job;
+}
+
+/**
+  Brings the target CPU time owed per ticket up to time: over the time since
+  the last update, the busy cores are shared out by the tickets of the
+  runnable jobs.
+*/
+static void share_advance(scheduler_t *s, int time)
+{
+	if(s->runnableWeight > 0)
+	{
+		int busy = (s->numRunnable < s->numCores) ? s->numRunnable : s->numCores;
+		s->sharePerTicket += (double)(time - s->shareTime) * busy / s->runnableWeight;
+	}
+	s->shareTime = time;
+}
+
+/**
+  Adds the CPU time a finished job received against its target share to the
+  share statistics.
+
+  @return the target CPU time of the job, 0 if none was owed
+*/
+static double record_share(scheduler_t *s, job_t *job, int time)
+{
+	double target = (s->sharePerTicket - job->shareStart) * job->weight;
+	if(target > time - job->arrival_time)
+	{
+		//a job never runs on more than one core
+		target = time - job->arrival_time;
+	}
+	if(target <= 0)
+	{
+		return 0;
+	}
+
+	scheduler_share_stats_t *sh = &s->shares;
+	double ratio = job->running_time / target;
+	if(sh->jobs == 0 || ratio < sh->min_ratio)
+	{
+		sh->min_ratio = ratio;
+	}
+	if(sh->jobs == 0 || ratio > sh->max_ratio)
+	{
+		sh->max_ratio = ratio;
+	}
+	sh->jobs++;
+	sh->total_ratio += ratio;
+
+	int class = job->priority;
+	if(class < -20)
+		class = -20;
+	if(class > 19)
+		class = 19;
+	sh->class_jobs[class + 20]++;
+	sh->class_received[class + 20] += job->running_time;
+	sh->class_target[class + 20] += target;
+	return target;
+}
+
+/**
+  Puts a job that is not running into the queue it waits in. Under MLFQ this
+  is the back of the queue of its level, under LOTTERY the ticket tree. With
+  per-core run queues it is the
+  queue of the core the job last ran on, or of the core the placement policy
+  picks for a new job.
+*/
+static void queue_job(scheduler_t *s, job_t *job)
+{
+	if(s->currScheme == LOTTERY)
+	{
+		lottery_enter(s, job);
+		return;
+	}
+	if(s->currScheme == MLFQ)
+	{
+		priqueue_offer(&s->levels[job->level], job);
+		s->levelMask |= 1UL << job->level;
+		return;
+	}
+	if(s->coreQueues != NULL)
+	{
+		if(job->queueCore < 0)
+		{
+			job->queueCore = place_core(s);
+		}
+		priqueue_offer(&s->coreQueues[job->queueCore], job);
+		return;
+	}
+	priqueue_offer(&s->Queue, job);
+}
+
+/**
+  Takes the job that should run next on a core out of the queues.
+  Under MLFQ this is the head of the highest level that has jobs waiting,
+  under LOTTERY the holder of the ticket drawn.
+  With per-core run queues it is the head of the core's own queue, or a job
+  taken from another core when that queue is empty.
+
+  @return NULL if no job is waiting
+*/
+static job_t *next_job(scheduler_t *s, int core_id)
+{
+	if(s->currScheme == LOTTERY)
+	{
+		return lottery_draw(s);
+	}
+	if(s->currScheme == MLFQ)
+	{
+		if(s->levelMask == 0)
+		{
+			return NULL;
+		}
+		int level = __builtin_ctzl(s->levelMask);
+		job_t *job = priqueue_poll(&s->levels[level]);
+		if(priqueue_size(&s->levels[level]) == 0)
+		{
+			s->levelMask &= ~(1UL << level);
+		}
+		return job;
+	}
+	job_t *job;
+	if(s->coreQueues != NULL)
+	{
+		job = priqueue_poll(&s->coreQueues[core_id]);
+		if(job == NULL)
+		{
+			job = steal_job(s, core_id);
+		}
+	}
+	else
+	{
+		job = priqueue_poll(&s->Queue);
+	}
+	//under CFS and STRIDE the queue's virtual time follows the jobs it hands out
+	if((s->currScheme == CFS || s->currScheme == STRIDE) && job != NULL && job->vruntime > s->minVruntime)
+	{
+		s->minVruntime = job->vruntime;
+	}
+	return job;
+}
+
+/**
+  MLFQ: once time has reached the next boost, moves every job back to the
+  top level with a fresh quantum. Running jobs finish the slice they are in,
+  and then count as top level jobs that have used up their quantum.
+*/
+static void mlfq_boost(scheduler_t *s, int time)
+{
+	if(s->currScheme != MLFQ || time < s->nextBoost)
+	{
+		return;
+	}
+	s->nextBoost = (time / s->params.mlfq_boost + 1) * s->params.mlfq_boost;
+
+	int level, i;
+	job_t *job;
+	for(level = 1 ; level < s->params.mlfq_levels ; level++)
+	{
+		while((job = priqueue_poll(&s->levels[level])) != NULL)
+		{
+			job->level = 0;
+			job->slice_used = 0;
+			priqueue_offer(&s->levels[0], job);
+		}
+	}
+	s->levelMask = (priqueue_size(&s->levels[0]) > 0) ? 1 : 0;
+	for(i = 0 ; i < s->numCores ; i++)
+	{
+		if(s->coreJobs[i] != NULL)
+		{
+			s->coreJobs[i]->level = 0;
+			s->coreJobs[i]->slice_used = 0;
+		}
+	}
+}
+
+
+/**
+  Sets up a queue of waiting jobs ordered the way the scheme picks them.
+*/
+static void init_queue(scheduler_t *s, priqueue_t *q)
+{
+	if(s->currScheme == PRI || s->currScheme == PPRI)
+		priqueue_init_buckets(q, comparePriority, priorityKey, PRIORITY_BUCKETS);
+	else if(s->currScheme == SJF)
+		priqueue_init(q, compareBurst);
+	else if(s->currScheme == PSJF)
+		priqueue_init(q, compareBurst);
+	else if(s->currScheme == RR || s->currScheme == MLFQ || s->currScheme == LOTTERY)
+		priqueue_init(q, compareRR);
+	else if(s->currScheme == EDF || s->currScheme == PEDF)
+		//only the earliest deadline is ever looked at, a heap is enough
+		priqueue_init_backend(q, compareDeadline, PRIQUEUE_HEAP);
+	else if(s->currScheme == STRIDE)
+		//the pass values in a heap, the lowest pass runs next
+		priqueue_init_backend(q, compareVruntime, PRIQUEUE_HEAP);
+	else if(s->currScheme == CFS)
+		//the runnable jobs are in a balanced tree, so picking the one with
+		//the least virtual runtime stays O(log n) at any depth
+		priqueue_init_backend(q, compareVruntime, PRIQUEUE_TREE);
+	else
+		priqueue_init(q, compareArrival);
+}
+
+
+/**
+  Initalizes the scheduler.
+
+  Assumptions:
+    - You may assume this will be the first scheduler function called.
+    - You may assume this function will be called once once.
+    - You may assume that cores is a positive, non-zero number.
+    - You may assume that scheme is a valid scheduling scheme.
+
+  @param s the scheduler
+  @param cores the number of cores that is available by the scheduler.
+	These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
+  @param scheme  the scheduling scheme that should be used. This value will be
+	one of the enum values of scheme_t
+  @param params tunables of the schemes and run queues, NULL for the defaults
+*/
+void scheduler_start_up_params_r(scheduler_t *s, int cores, scheme_t scheme, const scheduler_params_t *params)
+{
+	s->currScheme  = scheme;
+	s->numCores    = cores;
+
+	if(params != NULL)
+		s->params = *params;
+	else
+		memset(&s->params, 0, sizeof(s->params));
+	if(s->params.mlfq_levels <= 0)
+		s->params.mlfq_levels = 3;
+	if(s->params.mlfq_levels > CORE_WORD_BITS)
+		s->params.mlfq_levels = CORE_WORD_BITS;
+	if(s->params.mlfq_quantum <= 0)
+		s->params.mlfq_quantum = 2;
+	if(s->params.mlfq_boost <= 0)
+		s->params.mlfq_boost = 100;
+	if(s->params.cfs_latency <= 0)
+		s->params.cfs_latency = 6;
+	if(s->params.cfs_granularity <= 0)
+		s->params.cfs_granularity = 1;
+	if(s->params.share_quantum <= 0)
+		s->params.share_quantum = 1;
+	if(s->params.lottery_seed <= 0)
+		s->params.lottery_seed = 1;
+
+	if(s->params.rq_place <= 0)
+		s->params.rq_place = RQ_PLACE_SHORTEST;
+	if(s->params.rq_steal <= 0)
+		s->params.rq_steal = RQ_STEAL_BUSIEST;
+
+	init_queue(s, &s->Queue);
+
+	s->coreQueues = NULL;
+	s->nextPlace  = 0;
+	if(s->params.per_core && s->currScheme != MLFQ && s->currScheme != LOTTERY)
+	{
+		int i;
+		s->coreQueues = malloc(cores * sizeof(priqueue_t));
+		for(i = 0 ; i < cores ; i++)
+		{
+			init_queue(s, &s->coreQueues[i]);
+		}
+	}
+	s->coreStats = calloc(cores, sizeof(scheduler_core_stats_t));
+
+	if(s->currScheme == PPRI)
+		priqueue_init_backend(&s->Victims, compareVictimPriority, PRIQUEUE_HEAP);
+	else if(s->currScheme == PSJF)
+		priqueue_init_backend(&s->Victims, compareVictimBurst, PRIQUEUE_HEAP);
+	else if(s->currScheme == PEDF)
+		priqueue_init_backend(&s->Victims, compareVictimDeadline, PRIQUEUE_HEAP);
+	else
+		priqueue_init(&s->Victims, compareRR);
+
+	s->levels    = NULL;
+	s->levelMask = 0;
+	s->nextBoost = s->params.mlfq_boost;
+	if(s->currScheme == MLFQ)
+	{
+		int level;
+		s->levels = malloc(s->params.mlfq_levels * sizeof(priqueue_t));
+		for(level = 0 ; level < s->params.mlfq_levels ; level++)
+		{
+			priqueue_init(&s->levels[level], compareRR);
+		}
+	}
+
+	int words = (s->numCores + CORE_WORD_BITS - 1) / CORE_WORD_BITS;
+	s->coreJobs  = calloc(s->numCores, sizeof(job_t*));
+	s->idleCores = calloc(words, sizeof(unsigned long));
+	s->numIdle   = 0;
+	s->lastJobs  = malloc(s->numCores * sizeof(int));
+	int i;
+	for(i = 0 ; i < s->numCores ; i++)
+	{
+		set_core(s, i, NULL);
+		s->lastJobs[i] = -1;
+	}
+
+	s->minVruntime    = 0;
+	s->runnableWeight = 0;
+	s->numRunnable    = 0;
+
+	memset(&s->deadlines, 0, sizeof(s->deadlines));
+
+	s->ticketTree     = NULL;
+	s->ticketJobs     = NULL;
+	s->freeSlots      = NULL;
+	s->numFree        = 0;
+	s->ticketSlots    = 0;
+	s->usedSlots      = 0;
+	s->waitingTickets = 0;
+	s->lotteryState   = s->params.lottery_seed;
+
+	s->sharePerTicket = 0;
+	s->shareTime      = 0;
+	memset(&s->shares, 0, sizeof(s->shares));
+
+	s->totalJobs             = 0;
+	s->total_waiting_time    = 0;
+	s->total_response_time   = 0;
+	s->total_turnaround_time = 0;
+	s->histograms = calloc(3, sizeof(scheduler_histogram_t));
+
+	s->jobSink        = NULL;
+	s->jobSinkContext = NULL;
+
+	memset(&s->counters, 0, sizeof(s->counters));
+}
+
+
+/**
+  Initalizes the scheduler with the default tunables,
+  see scheduler_start_up_params_r().
+*/
+void scheduler_start_up_r(scheduler_t *s, int cores, scheme_t scheme)
+{
+	scheduler_start_up_params_r(s, cores, scheme, NULL);
+}
+
+
+/**
+  Tells how long the job that was just scheduled on a core may run before
+  scheduler_quantum_expired_r() has to be called for the core: the quantum
+  under RR, what is left of the quantum of the job's level under MLFQ, the
+  job's weighted share of the target latency under CFS, and the share
+  quantum under STRIDE and LOTTERY.
+
+  @param s the scheduler
+  @param core_id the zero-based index of the core
+  @return the number of time units left in the time slice
+  @return 0 if the scheme does not slice time or the core is idle
+*/
+int scheduler_time_slice_r(scheduler_t *s, int core_id)
+{
+	job_t *job = s->coreJobs[core_id];
+	if(job == NULL)
+	{
+		return 0;
+	}
+	if(s->currScheme == RR)
+	{
+		return s->params.quantum;
+	}
+	if(s->currScheme == MLFQ)
+	{
+		int left = mlfq_quantum(s, job->level) - job->slice_used;
+		return (left > 0) ? left : 1;
+	}
+	if(s->currScheme == CFS)
+	{
+		return cfs_slice(s, job);
+	}
+	if(s->currScheme == STRIDE || s->currScheme == LOTTERY)
+	{
+		return s->params.share_quantum;
+	}
 	return 0;
 }
 
 
 /**
-  Initalizes the scheduler.
+  Reports what a core has done so far: how long it ran jobs, and how many
+  jobs were put on it, came from another core or were stolen by it.
 
-  Assumptions:
-    - You may assume this will be the first scheduler function called.
-    - You may assume this function will be called once once.
-    - You may assume that cores is a positive, non-zero number.
-    - You may assume that scheme is a valid scheduling scheme.
+  @param s the scheduler
+  @param core_id the zero-based index of the core
+  @param stats filled in with the counters of the core
+*/
+void scheduler_core_stats_r(scheduler_t *s, int core_id, scheduler_core_stats_t *stats)
+{
+	*stats = s->coreStats[core_id];
+}
 
-  @param cores the number of cores that is available by the scheduler.
-	These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
-  @param scheme  the scheduling scheme that should be used. This value will be
-	one of the six enum values of scheme_t
+
+/**
+  Reports how the finished jobs that had a deadline fared: how many missed
+  it, and by how much they finished before or after it.
+
+  @param s the scheduler
+  @param stats filled in with the deadline statistics
 */
-void scheduler_start_up(int cores, scheme_t scheme)
+void scheduler_deadline_stats_r(scheduler_t *s, scheduler_deadline_stats_t *stats)
 {
-	currScheme  = scheme;
-	numCores    = cores;
-
-	if(currScheme == PRI)
-		priqueue_init(&Queue, comparePriority);
-	else if(currScheme == PPRI)
-		priqueue_init(&Queue, comparePriority);
-	else if(currScheme == SJF)
-		priqueue_init(&Queue, compareBurst);
-	else if(currScheme == PSJF)
-		priqueue_init(&Queue, compareBurst);
-	else if(currScheme == RR)
-		priqueue_init(&Queue, compareRR);
-	else
-		priqueue_init(&Queue, compareArrival);
+	*stats = s->deadlines;
+}
+
+
+/**
+  Reports how close the finished jobs came to the CPU time their tickets
+  entitle them to, see scheduler_share_stats_t.
+
+  @param s the scheduler
+  @param stats filled in with the share statistics
+*/
+void scheduler_share_stats_r(scheduler_t *s, scheduler_share_stats_t *stats)
+{
+	*stats = s->shares;
+}
+
+
+/**
+  Sets a function to be handed a record of every job as it finishes, for
+  example to stream them to a file. Without a sink the records are never
+  built.
+
+  @param s the scheduler
+  @param sink the function to call, NULL for none
+  @param context passed on to every call of sink
+*/
+void scheduler_job_sink_r(scheduler_t *s, scheduler_job_sink_t sink, void *context)
+{
+	s->jobSink        = sink;
+	s->jobSinkContext = context;
+}
+
+
+/**
+  Adds the counters of a queue to the scheduler's totals.
+*/
+static void add_queue_counters(scheduler_counters_t *counters, priqueue_t *q)
+{
+	priqueue_counters_t c;
+	priqueue_alloc_stats_t a;
+	priqueue_counters(q, &c);
+	priqueue_alloc_stats(q, &a);
+	counters->queues.compares  += c.compares;
+	counters->queues.traversed += c.traversed;
+	counters->alloc.mallocs    += a.mallocs;
+	counters->alloc.nodes      += a.nodes;
+	counters->alloc.recycled   += a.recycled;
+}
+
+/**
+  Reports the hot-path counters of the scheduler: the work of all its
+  queues, preemptions, quantum expiries and context switches. The context
+  switches of every core are in its scheduler_core_stats_r().
 
-	totalJobs           = 0;
-	avg_waiting_time    = 0.0;
-	avg_response_time   = 0.0;
-	avg_turnaround_time = 0.0;
+  @param s the scheduler
+  @param counters filled in with the counters
+  @return 1 if the counters are compiled in
+  @return 0 if they are not, and every counter but the allocations is 0
+*/
+int scheduler_counters_r(scheduler_t *s, scheduler_counters_t *counters)
+{
+	int i;
+	*counters = s->counters;
+	add_queue_counters(counters, &s->Queue);
+	add_queue_counters(counters, &s->Victims);
+	if(s->coreQueues != NULL)
+	{
+		for(i = 0 ; i < s->numCores ; i++)
+		{
+			add_queue_counters(counters, &s->coreQueues[i]);
+		}
+	}
+	if(s->levels != NULL)
+	{
+		for(i = 0 ; i < s->params.mlfq_levels ; i++)
+		{
+			add_queue_counters(counters, &s->levels[i]);
+		}
+	}
+	for(i = 0 ; i < s->numCores ; i++)
+	{
+		counters->context_switches += s->coreStats[i].context_switches;
+	}
+#if defined(SCHEDULER_COUNTERS) && defined(PRIQUEUE_COUNTERS)
+	return 1;
+#else
+	return 0;
+#endif
 }
 
 
@@ -126,17 +1128,21 @@ void scheduler_start_up(int cores, scheme_t scheme)
   Assumption:
     - You may assume that every job wil have a unique arrival time.
 
+  @param s the scheduler
   @param job_number a globally unique identification number of the job arriving.
   @param time the current time of the simulator.
   @param running_time the total number of time units this job will run before
 	it will be finished.
   @param priority the priority of the job. (The lower the value, the higher the
 	priority.)
+  @param deadline the number of time units after its arrival the job should
+	be finished by, 0 if it has no deadline. EDF and PEDF run the job that is
+	due first; every scheme counts the deadlines missed.
   @return index of core job should be scheduled on
   @return -1 if no scheduling changes should be made.
 
  */
-int scheduler_new_job(int job_number, int time, int running_time, int priority)
+int scheduler_new_job_deadline_r(scheduler_t *s, int job_number, int time, int running_time, int priority, int deadline)
 {
 	job_t* newJob           = malloc(sizeof(job_t));
 	newJob->job_number      = job_number;
@@ -148,190 +1154,143 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
 	newJob->coreNum         = -1;
 	newJob->start_time      = -1;
 	newJob->last_start_time = -1;
+	newJob->level           = 0;
+	newJob->slice_used      = 0;
+	newJob->weight          = cfs_weight(priority);
+	newJob->vruntime        = s->minVruntime;
+	newJob->queueCore       = -1;
+	newJob->lastCore        = -1;
+	newJob->deadline        = (deadline > 0) ? (long long)time + deadline : LLONG_MAX;
+	newJob->first_start     = -1;
+	newJob->preemptions     = 0;
+	newJob->migrations      = 0;
 
-	totalJobs++;
+	share_advance(s, time);
+	newJob->shareStart      = s->sharePerTicket;
+
+	s->totalJobs++;
+	s->numRunnable++;
+	s->runnableWeight += newJob->weight;
+	mlfq_boost(s, time);
 
 	//if it's FCFS, the data field that should be compared within the queue
 	//is going to be the time (or arrival_time)
-	if(currScheme == FCFS || currScheme == PRI || currScheme == SJF || currScheme == RR)
+	//see if there is a core not being used, put new job on it
+	int idleCore = first_idle_core(s);
+	if(idleCore >= 0)
+	{
+		newJob->coreNum         = idleCore;
+		newJob->start_time      = time;
+		newJob->last_start_time = time;
+		set_core(s, idleCore, newJob);
+		core_dispatched(s, idleCore, newJob, time);
+		return idleCore;
+	}
+
+	//CFS, STRIDE and LOTTERY do not preempt on arrival, the next quantum
+	//expiry does
+	if(s->currScheme == FCFS || s->currScheme == PRI || s->currScheme == SJF || s->currScheme == RR ||
+	   s->currScheme == CFS || s->currScheme == EDF || s->currScheme == STRIDE || s->currScheme == LOTTERY)
 	{
-		int i,j;
-		int size = priqueue_size(&Queue);
-		//loop through the cores and see if there is space
-		for(i = 0 ; i < numCores ; i++)
-		{
-			int coreInUse = 0;
-			for(j = 0 ; j < size ; j++)
-			{
-				job_t *temp = priqueue_at(&Queue, j);
-				if(temp->coreNum == i)
-				{
-					coreInUse = 1;
-					j = size;
-				}
-			}
-			//core not being used, put new job on it
-			if(coreInUse == 0)
-			{
-				newJob->coreNum         = i;
-				newJob->start_time      = time;
-				newJob->last_start_time = time;
-				priqueue_offer(&Queue, newJob);
-				return i;
-			}
-		}
 		//no availabe cores, put the node in the queue
-		priqueue_offer(&Queue, newJob);
+		queue_job(s, newJob);
 		return -1;
 	}
-	else if(currScheme == PPRI)
+	else if(s->currScheme == PPRI || s->currScheme == PSJF || s->currScheme == PEDF)
 	{
-		int currHighestPri = -1;
-		int indexOfHigh    = -1;
-		//int arrival        = 0;
-		int i,j;
-		int size           = priqueue_size(&Queue);
-		//loop through the cores and see if there is space
-		for(i = 0 ; i < numCores ; i++)
-		{
-			int coreInUse = 0;
-			for(j = 0 ; j < size ; j++)
-			{
-				job_t *temp = priqueue_at(&Queue, j);
-				if(temp->coreNum == i)
-				{
-					if(temp->priority > currHighestPri)
-					{
-						currHighestPri = temp->priority;
-						indexOfHigh = j;
-					}
-					coreInUse = 1;
-					j = size;
-				}
-			}
-			//core not being used, put new job on it
-			if(coreInUse == 0)
-			{
-				newJob->coreNum         = i;
-				newJob->start_time      = time;
-				newJob->last_start_time = time;
-				priqueue_offer(&Queue, newJob);
-				return i;
-			}
-		}
-		//all the cores are occupied
-		//we stored the highest priority
-
-		job_t *temp = priqueue_at(&Queue, indexOfHigh);
-		if(temp->priority > newJob->priority)
+		//all the cores are occupied, the victim heads the victims: the
+		//lowest priority running job under PPRI, the one with the most
+		//remaining time under PSJF and the one due last under PEDF
+		job_t *temp = priqueue_peek(&s->Victims);
+		if(preempts(s, newJob, temp))
 		{
-			temp                    = priqueue_remove_at(&Queue, indexOfHigh);
 			int progressTime        = time - temp->last_start_time;
 			temp->remaining_time    = temp->remaining_time - progressTime;
 			int coreIndex           = temp->coreNum;
+			s->coreStats[coreIndex].busy_time += progressTime;
 			temp->coreNum           = -1;
+			//a job preempted the moment it started has not started yet
 			if(temp->start_time == time)
 			{
 				temp->start_time      = -1;
+				temp->first_start     = -1;
 			}
 			temp->last_start_time   = -1;
-			priqueue_offer(&Queue, temp);
+			temp->preemptions++;
+			COUNT(s->counters.preemptions++);
+			//requeue the preempted job with its new remaining time
+			queue_job(s, temp);
 
 			newJob->coreNum         = coreIndex;
 			newJob->start_time      = time;
 			newJob->last_start_time = time;
-			priqueue_offer(&Queue, newJob);
+			set_core(s, coreIndex, newJob);
+			core_dispatched(s, coreIndex, newJob, time);
 			return coreIndex;
 		}
-		// no cores available and the running jobs have higher priority
-		priqueue_offer(&Queue, newJob);
+		// no cores available and the running jobs come first
+		queue_job(s, newJob);
 		return -1;
 	}
-	else if(currScheme == PSJF)
+	else if(s->currScheme == MLFQ)
 	{
-		int currLongest    = -1;
-		int indexOfLong    = -1;
-		int arrival        = 0;
-		int i,j;
-		int size           = priqueue_size(&Queue);
-		//loop through the cores and see if there is space
-		for(i = 0 ; i < numCores ; i++)
+		//new jobs start on the top level, so they preempt the job running
+		//on the lowest level if that is below the top
+		job_t *victim = NULL;
+		int i;
+		for(i = 0 ; i < s->numCores ; i++)
 		{
-			int coreInUse = 0;
-			for(j = 0 ; j < size ; j++)
-			{
-				job_t *temp = priqueue_at(&Queue, j);
-				if(temp->coreNum == i)
-				{
-					if(temp->remaining_time >= currLongest)
-					{
-						//need to check the arrival times
-						if(temp->remaining_time == currLongest)
-						{
-							if(temp->arrival_time > arrival)
-							{
-								arrival = temp->arrival_time;
-								currLongest = temp->remaining_time;
-								indexOfLong = j;
-							}
-						}
-						else
-						{
-							arrival = temp->arrival_time;
-							currLongest = temp->remaining_time;
-							indexOfLong = j;
-						}
-					}
-					coreInUse = 1;
-					j = size;
-				}
-			}
-			//core not being used, put new job on it
-			if(coreInUse == 0)
+			job_t *temp = s->coreJobs[i];
+			if(temp->level > 0 && (victim == NULL || temp->level > victim->level))
 			{
-				newJob->coreNum         = i;
-				newJob->start_time      = time;
-				newJob->last_start_time = time;
-				priqueue_offer(&Queue, newJob);
-				return i;
+				victim = temp;
 			}
 		}
-		//all the cores are occupied
-		//we stored the highest priority
 
-		job_t *temp = priqueue_at(&Queue, indexOfLong);
-		if(temp->remaining_time > newJob->remaining_time)
+		if(victim != NULL)
 		{
-			printf("temp->remaining_time %d\n", temp->remaining_time);
-			printf("newJob->remaining_time %d\n", newJob->remaining_time);
-			temp                    = priqueue_remove_at(&Queue, indexOfLong);
-			int progressTime        = time - temp->last_start_time;
-			temp->remaining_time    = temp->remaining_time - progressTime;
-			int coreIndex           = temp->coreNum;
-			temp->coreNum           = -1;
-			if(temp->start_time == time)
+			int progressTime        = time - victim->last_start_time;
+			victim->remaining_time  = victim->remaining_time - progressTime;
+			victim->slice_used      = victim->slice_used + progressTime;
+			int coreIndex           = victim->coreNum;
+			s->coreStats[coreIndex].busy_time += progressTime;
+			victim->coreNum         = -1;
+			if(victim->start_time == time)
 			{
-				temp->start_time      = -1;
+				victim->start_time    = -1;
+				victim->first_start   = -1;
 			}
-			temp->last_start_time   = -1;
-			priqueue_offer(&Queue, temp);
+			victim->last_start_time = -1;
+			victim->preemptions++;
+			COUNT(s->counters.preemptions++);
+			//the victim keeps its level and what it used of its quantum
+			queue_job(s, victim);
 
 			newJob->coreNum         = coreIndex;
 			newJob->start_time      = time;
 			newJob->last_start_time = time;
-			priqueue_offer(&Queue, newJob);
+			set_core(s, coreIndex, newJob);
+			core_dispatched(s, coreIndex, newJob, time);
 			return coreIndex;
 		}
-		// no cores available and the running jobs have higher priority
-		priqueue_offer(&Queue, newJob);
+		queue_job(s, newJob);
 		return -1;
-
 	}
 
 	return -1;
 }
 
 
+/**
+  Called when a new job without a deadline arrives,
+  see scheduler_new_job_deadline_r().
+*/
+int scheduler_new_job_r(scheduler_t *s, int job_number, int time, int running_time, int priority)
+{
+	return scheduler_new_job_deadline_r(s, job_number, time, running_time, priority, 0);
+}
+
+
 /**
   Called when a job has completed execution.
 
@@ -341,52 +1300,70 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
   finished job, return the job_number of the job that should be scheduled to
   run on core core_id.
 
+  @param s the scheduler
   @param core_id the zero-based index of the core where the job was located.
   @param job_number a globally unique identification number of the job.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled to run on core core_id
   @return -1 if core should remain idle.
  */
-int scheduler_job_finished(int core_id, int job_number, int time)
+int scheduler_job_finished_r(scheduler_t *s, int core_id, int job_number, int time)
 {
 	//find the job on the core
-	job_t *temp;
-	int i;
-	int size = priqueue_size(&Queue);
-	for( i = 0 ; i < size ; i++)
+	job_t *temp = s->coreJobs[core_id];
+
+	//temp points the job that just finished, get some stats
+	int response   = temp->start_time - temp->arrival_time;
+	int waiting    = time - temp->running_time - temp->arrival_time;
+	int turnaround = time - temp->arrival_time;
+	s->total_response_time   += response;
+	s->total_waiting_time    += waiting;
+	s->total_turnaround_time += turnaround;
+	histogram_record(&s->histograms[METRIC_RESPONSE], response);
+	histogram_record(&s->histograms[METRIC_WAITING], waiting);
+	histogram_record(&s->histograms[METRIC_TURNAROUND], turnaround);
+	if(temp->deadline != LLONG_MAX)
 	{
-		temp = priqueue_at(&Queue, i);
-		if(temp->coreNum == core_id)
-		{
-			break;
-		}
+		record_lateness(s, time - temp->deadline);
+	}
+	share_advance(s, time);
+	double target = record_share(s, temp, time);
+	if(s->jobSink != NULL)
+	{
+		scheduler_job_record_t record;
+		record.job_number   = temp->job_number;
+		record.arrival_time = temp->arrival_time;
+		record.first_start  = temp->first_start;
+		record.finish_time  = time;
+		record.running_time = temp->running_time;
+		record.priority     = temp->priority;
+		record.preemptions  = temp->preemptions;
+		record.migrations   = temp->migrations;
+		record.share_received = temp->running_time;
+		record.share_target   = target;
+		s->jobSink(s->jobSinkContext, &record);
 	}
-	temp = priqueue_remove_at(&Queue, i);
 
-	//temp points the job that just finished, get some stats
-	avg_response_time   += temp->start_time - temp->arrival_time;
-	avg_waiting_time    += time - temp->running_time - temp->arrival_time;
-	avg_turnaround_time += time - temp->arrival_time;
+	s->numRunnable--;
+	s->runnableWeight -= temp->weight;
+	s->coreStats[core_id].busy_time += time - temp->last_start_time;
+
+	//boost while the finished job still holds its core
+	mlfq_boost(s, time);
 
 	//job finished, free the assets
+	set_core(s, core_id, NULL);
 	free(temp);
 
-	//search the queue for non running jobs, put the highest 'priority' on a core
-	size = priqueue_size(&Queue);
-	for(i = 0 ; i < size ; i++)
+	//the head of the queue is the highest 'priority' waiting job, put it on
+	temp = next_job(s, core_id);
+	set_core(s, core_id, temp);
+	if(temp != NULL)
 	{
-		temp = priqueue_at(&Queue, i);
-		//highest priority val to put on
-		if(temp->coreNum < 0)
-		{
-			if(temp->start_time < 0)
-			{
-				temp->start_time = time;
-			}
-			temp->coreNum = core_id;
-			temp->last_start_time = time;
-			return temp->job_number;
-		}
+		core_dispatched(s, core_id, temp, time);
+		temp->coreNum = core_id;
+		temp->last_start_time = time;
+		return temp->job_number;
 	}
 	//else there's no idle jobs
 	return -1;
@@ -394,50 +1371,71 @@ int scheduler_job_finished(int core_id, int job_number, int time)
 
 
 /**
-  When the scheme is set to RR, called when the quantum timer has expired
-  on a core.
+  When the scheme is set to RR, MLFQ, CFS, STRIDE or LOTTERY, called when the
+  time slice of a core has run out, see scheduler_time_slice_r(). Under MLFQ
+  the job has used up the quantum of its level and moves one level down.
+  Under CFS and STRIDE the job is charged for the slice and the job with the
+  least virtual runtime (pass) runs next. Under LOTTERY the job goes back
+  into the draws and the holder of the next ticket drawn runs.
 
   If any job should be scheduled to run on the core free'd up by
   the quantum expiration, return the job_number of the job that should be
   scheduled to run on core core_id.
 
+  @param s the scheduler
   @param core_id the zero-based index of the core where the quantum has expired.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled on core cord_id
   @return -1 if core should remain idle
  */
-int scheduler_quantum_expired(int core_id, int time)
+int scheduler_quantum_expired_r(scheduler_t *s, int core_id, int time)
 {
 	//core_id has expired
 	//we take whatever value is in that core,
 	//push it to the back of the queue
 	//then cycle through the queue to find the first availabe value
-	int i;
-	int size = priqueue_size(&Queue);
-	for(i = 0 ; i < size ; i++)
+	job_t *temp = s->coreJobs[core_id];
+	job_t *expired = temp;
+	COUNT(s->counters.quantum_expiries++);
+	if(temp != NULL)
 	{
-		job_t *temp = priqueue_at(&Queue, i);
-		if(temp->coreNum == core_id)
+		int progressTime      = time - temp->last_start_time;
+		temp->remaining_time  = temp->remaining_time - progressTime;
+		temp->coreNum         = -1;
+		s->coreStats[core_id].busy_time += progressTime;
+		temp->last_start_time = -1;
+		if(s->currScheme == MLFQ)
 		{
-			temp                  = priqueue_remove_at(&Queue, i);
-			int progressTime      = time - temp->last_start_time;
-			temp->remaining_time  = temp->remaining_time - progressTime;
-			temp->coreNum         = -1;
-			temp->last_start_time = -1;
-			priqueue_offer(&Queue, temp);
-			//done with this for loop
-			i = size;
+			if(temp->level < s->params.mlfq_levels - 1)
+			{
+				temp->level++;
+			}
+			temp->slice_used = 0;
 		}
-	}
-	for(i = 0 ; i < size ; i++)
-	{
-		job_t *temp = priqueue_at(&Queue, i);
-		if(temp->coreNum == -1)
+		else if(s->currScheme == CFS || s->currScheme == STRIDE)
 		{
-			temp->coreNum = core_id;
-			temp->last_start_time = time;
-			return temp->job_number;
+			//the pass of STRIDE moves by the stride, 1/tickets, per time unit
+			temp->vruntime += cfs_vruntime_delta(temp, progressTime);
 		}
+		//send it to the back of the queue, under CFS and STRIDE to its place
+		//by virtual runtime
+		queue_job(s, temp);
+	}
+	mlfq_boost(s, time);
+
+	//the head of the queue runs next, possibly the same job again
+	temp = next_job(s, core_id);
+	if(expired != NULL && temp != expired)
+	{
+		expired->preemptions++;
+	}
+	set_core(s, core_id, temp);
+	if(temp != NULL)
+	{
+		core_dispatched(s, core_id, temp, time);
+		temp->coreNum = core_id;
+		temp->last_start_time = time;
+		return temp->job_number;
 	}
 	return -1;
 }
@@ -449,11 +1447,12 @@ int scheduler_quantum_expired(int core_id, int time)
   Assumptions:
     - This function will only be called after all scheduling is complete (all
 		jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average waiting time of all jobs scheduled.
  */
-float scheduler_average_waiting_time()
+float scheduler_average_waiting_time_r(scheduler_t *s)
 {
-	return avg_waiting_time / totalJobs;
+	return (double)s->total_waiting_time / s->totalJobs;
 }
 
 
@@ -463,11 +1462,12 @@ float scheduler_average_waiting_time()
   Assumptions:
     - This function will only be called after all scheduling is complete
 		(all jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average turnaround time of all jobs scheduled.
  */
-float scheduler_average_turnaround_time()
+float scheduler_average_turnaround_time_r(scheduler_t *s)
 {
-	return avg_turnaround_time / totalJobs;
+	return (double)s->total_turnaround_time / s->totalJobs;
 }
 
 
@@ -477,11 +1477,86 @@ float scheduler_average_turnaround_time()
   Assumptions:
     - This function will only be called after all scheduling is complete
 		(all jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average response time of all jobs scheduled.
  */
-float scheduler_average_response_time()
+float scheduler_average_response_time_r(scheduler_t *s)
+{
+	return (double)s->total_response_time / s->totalJobs;
+}
+
+
+/**
+  Returns a percentile of a metric of the finished jobs, read off its
+  histogram: the largest value of the bucket that holds the job at that
+  rank, so it is at most 1/64 of its magnitude above the true value, and
+  never above the largest value recorded. Negative values rank below all
+  others, as they do in the averages.
+
+  Assumptions:
+    - This function will only be called after all scheduling is complete
+		(all jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
+  @param metric the metric, one of the values of scheduler_metric_t
+  @param percentile the percentile, from 0 to 100, e.g. 99.9
+  @return the percentile of the metric
+  @return 0 if no job has finished
+ */
+int scheduler_percentile_r(scheduler_t *s, scheduler_metric_t metric, double percentile)
+{
+	scheduler_histogram_t *h = &s->histograms[metric];
+	if(h->count == 0)
+	{
+		return 0;
+	}
+
+	//the rank of the job at the percentile, rounded up
+	double exact = percentile * h->count / 100;
+	long rank = (long)exact;
+	if(rank < exact - 1e-9)
+	{
+		rank++;
+	}
+	if(rank < 1)
+	{
+		rank = 1;
+	}
+
+	//the negative values first, the largest magnitude lowest
+	long seen = 0;
+	int i;
+	for(i = SCHEDULER_HISTOGRAM_BUCKETS - 1 ; i > 0 ; i--)
+	{
+		seen += h->negative[i];
+		if(seen >= rank)
+		{
+			long long upper = -histogram_lower(i);
+			return (upper < h->max) ? (int)upper : h->max;
+		}
+	}
+	for(i = 0 ; i < SCHEDULER_HISTOGRAM_BUCKETS ; i++)
+	{
+		seen += h->buckets[i];
+		if(seen >= rank)
+		{
+			long long upper = histogram_upper(i);
+			return (upper < h->max) ? (int)upper : h->max;
+		}
+	}
+	return h->max;
+}
+
+
+/**
+  Returns the largest value of a metric over the finished jobs.
+
+  @param s the scheduler
+  @param metric the metric, one of the values of scheduler_metric_t
+  @return the largest value, 0 if no job has finished
+ */
+int scheduler_max_r(scheduler_t *s, scheduler_metric_t metric)
 {
-	return avg_response_time / totalJobs;
+	return s->histograms[metric].max;
 }
 
 
@@ -490,10 +1565,54 @@ float scheduler_average_response_time()
 
   Assumption:
     - This function will be the last function called in your library.
+
+  @param s the scheduler
 */
-void scheduler_clean_up()
+void scheduler_clean_up_r(scheduler_t *s)
 {
-	priqueue_destroy(&Queue);
+	int i;
+	for(i = 0 ; i < s->numCores ; i++)
+	{
+		free(s->coreJobs[i]);
+	}
+	job_t *temp;
+	if(s->coreQueues != NULL)
+	{
+		for(i = 0 ; i < s->numCores ; i++)
+		{
+			while((temp = priqueue_poll(&s->coreQueues[i])) != NULL)
+			{
+				free(temp);
+			}
+			priqueue_destroy(&s->coreQueues[i]);
+		}
+		free(s->coreQueues);
+		s->coreQueues = NULL;
+	}
+	while((temp = next_job(s, 0)) != NULL)
+	{
+		free(temp);
+	}
+	priqueue_destroy(&s->Queue);
+	priqueue_destroy(&s->Victims);
+	free(s->ticketTree);
+	free(s->ticketJobs);
+	free(s->freeSlots);
+	free(s->coreStats);
+	free(s->histograms);
+	free(s->lastJobs);
+	if(s->levels != NULL)
+	{
+		int level;
+		for(level = 0 ; level < s->params.mlfq_levels ; level++)
+		{
+			priqueue_destroy(&s->levels[level]);
+		}
+		free(s->levels);
+		s->levels = NULL;
+	}
+	free(s->coreJobs);
+	free(s->idleCores);
 }
 
 
@@ -512,14 +1631,120 @@ void scheduler_clean_up()
 
   This function is not required and will not be graded. You may leave it
   blank if you do not find it useful.
+
+  Only the jobs waiting for a core are listed, in the order they will be
+  scheduled; running jobs are kept per core rather than in the queue. With
+  per-core run queues every core's queue is listed after its id in brackets.
+  Under LOTTERY the order is that of the ticket slots.
+
+  @param s the scheduler
  */
-void scheduler_show_queue()
+void scheduler_show_queue_r(scheduler_t *s)
 {
-	int size = priqueue_size(&Queue);
-	int i;
-	for(i = 0 ; i < size ; i++)
+	priqueue_iter_t it;
+	job_t *temp;
+	if(s->currScheme == LOTTERY)
+	{
+		//the waiting jobs by slot, any of them may be drawn next
+		int slot;
+		for(slot = 0 ; slot < s->usedSlots ; slot++)
+		{
+			if(s->ticketJobs[slot] != NULL)
+			{
+				printf("%d(%d) ", s->ticketJobs[slot]->job_number, s->ticketJobs[slot]->priority);
+			}
+		}
+		return;
+	}
+	if(s->currScheme == MLFQ)
+	{
+		int level;
+		for(level = 0 ; level < s->params.mlfq_levels ; level++)
+		{
+			for(temp = priqueue_iter_begin(&s->levels[level], &it) ; temp != NULL ; temp = priqueue_iter_next(&it))
+			{
+				printf("%d(%d) ", temp->job_number, temp->priority);
+			}
+		}
+		return;
+	}
+	if(s->coreQueues != NULL)
+	{
+		//one group per core, led by the core id in brackets
+		int i;
+		for(i = 0 ; i < s->numCores ; i++)
+		{
+			printf("[%d] ", i);
+			for(temp = priqueue_iter_begin(&s->coreQueues[i], &it) ; temp != NULL ; temp = priqueue_iter_next(&it))
+			{
+				printf("%d(%d) ", temp->job_number, temp->priority);
+			}
+		}
+		return;
+	}
+	for(temp = priqueue_iter_begin(&s->Queue, &it) ; temp != NULL ; temp = priqueue_iter_next(&it))
 	{
-		job_t *temp = priqueue_at(&Queue, i);
 		printf("%d(%d) ", temp->job_number, temp->priority);
 	}
 }
+
+
+/*
+  The original API, kept for single-scheduler programs such as the simulator.
+  Every call works on one default scheduler instance.
+*/
+
+void scheduler_start_up(int cores, scheme_t scheme)
+{
+	scheduler_start_up_r(&default_scheduler, cores, scheme);
+}
+
+int scheduler_new_job(int job_number, int time, int running_time, int priority)
+{
+	return scheduler_new_job_r(&default_scheduler, job_number, time, running_time, priority);
+}
+
+int scheduler_job_finished(int core_id, int job_number, int time)
+{
+	return scheduler_job_finished_r(&default_scheduler, core_id, job_number, time);
+}
+
+int scheduler_quantum_expired(int core_id, int time)
+{
+	return scheduler_quantum_expired_r(&default_scheduler, core_id, time);
+}
+
+float scheduler_average_waiting_time()
+{
+	return scheduler_average_waiting_time_r(&default_scheduler);
+}
+
+float scheduler_average_turnaround_time()
+{
+	return scheduler_average_turnaround_time_r(&default_scheduler);
+}
+
+float scheduler_average_response_time()
+{
+	return scheduler_average_response_time_r(&default_scheduler);
+}
+
+int scheduler_percentile(scheduler_metric_t metric, double percentile)
+{
+	return scheduler_percentile_r(&default_scheduler, metric, percentile);
+}
+
+int scheduler_max(scheduler_metric_t metric)
+{
+	return scheduler_max_r(&default_scheduler, metric);
+}
+
+void scheduler_clean_up()
+{
+	scheduler_clean_up_r(&default_scheduler);
+}
+
+void scheduler_show_queue()
+{
+	scheduler_show_queue_r(&default_scheduler);
+}
@@ -4,10 +4,243 @@
 #ifndef LIBSCHEDULER_H_
 #define LIBSCHEDULER_H_
 
+#include "../libpriqueue/libpriqueue.h"
+
 /**
   Constants which represent the different scheduling algorithms
 */
-typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR} scheme_t;
+typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, CFS, EDF, PEDF, STRIDE, LOTTERY} scheme_t;
+
+/**
+  Per-core run queues: the core whose queue a new job waits in when every
+  core is busy
+*/
+typedef enum {RQ_PLACE_SHORTEST = 1, RQ_PLACE_ROUND_ROBIN} rq_place_t;
+
+/**
+  Per-core run queues: the core an idle core takes a job from when its own
+  queue is empty
+*/
+typedef enum {RQ_STEAL_BUSIEST = 1, RQ_STEAL_NEIGHBOR, RQ_STEAL_NONE} rq_steal_t;
+
+/**
+  Per-job metrics kept by the scheduler, see scheduler_percentile_r()
+*/
+typedef enum {METRIC_WAITING = 0, METRIC_TURNAROUND, METRIC_RESPONSE} scheduler_metric_t;
+
+/**
+  Tunables of the schemes and of the run queues. A field left at 0 takes its
+  default.
+*/
+typedef struct _scheduler_params_t
+{
+	int quantum;       //RR: time units a job runs before its quantum expires
+	int mlfq_levels;   //MLFQ: number of levels (default 3, at most 64)
+	int mlfq_quantum;  //MLFQ: quantum of the top level, doubling on every
+	                   //level below it (default 2)
+	int mlfq_boost;    //MLFQ: every this many time units every job moves
+	                   //back to the top level (default 100)
+	int cfs_latency;     //CFS: target latency, the period in which every
+	                     //runnable job gets to run once (default 6)
+	int cfs_granularity; //CFS: shortest time slice a job is given (default 1)
+	int share_quantum;   //STRIDE, LOTTERY: time units a job runs per
+	                     //allocation (default 1)
+	int lottery_seed;    //LOTTERY: seed of the draws (default 1)
+	int per_core;        //1 for a run queue per core instead of one shared
+	                     //queue (every scheme but MLFQ and LOTTERY)
+	int rq_place;        //per-core run queues: rq_place_t (default shortest)
+	int rq_steal;        //per-core run queues: rq_steal_t (default busiest)
+} scheduler_params_t;
+
+/**
+  What one core did so far, see scheduler_core_stats_r()
+*/
+typedef struct _scheduler_core_stats_t
+{
+	long long busy_time;  //time units the core spent running jobs
+	long dispatches;      //times a job was put on the core
+	long migrations;      //jobs put on the core that last ran on another core
+	long steals;          //jobs the core took from the run queue of another core
+	long context_switches; //times the core was given another job than it ran
+	                       //last, counted only with SCHEDULER_COUNTERS
+} scheduler_core_stats_t;
+
+/**
+  Hot-path counters of a scheduler, see scheduler_counters_r(). They are only
+  counted when the libraries are built with SCHEDULER_COUNTERS and
+  PRIQUEUE_COUNTERS defined (make COUNTERS=1); otherwise the counting is
+  compiled out and they stay 0, except for the allocations.
+*/
+typedef struct _scheduler_counters_t
+{
+	priqueue_counters_t queues;    //summed over every queue of the scheduler
+	priqueue_alloc_stats_t alloc;  //summed over every queue, always counted
+	long preemptions;              //running jobs a new job took the core from
+	long quantum_expiries;
+	long context_switches;         //summed over the cores
+} scheduler_counters_t;
+
+/**
+  Lateness of the finished jobs that had a deadline, see
+  scheduler_deadline_stats_r(). Lateness is the finish time minus the
+  deadline, negative for a job that finished early.
+*/
+#define SCHEDULER_TARDINESS_BUCKETS 32
+
+typedef struct _scheduler_deadline_stats_t
+{
+	long jobs;                 //finished jobs that had a deadline
+	long misses;               //of those, the jobs that finished after it
+	long long total_lateness;
+	long long min_lateness;    //0 while no job had a deadline
+	long long max_lateness;
+	//missed deadlines by how late the job was: bucket 0 counts jobs 1 time
+	//unit late, bucket k jobs 2^k to 2^(k+1)-1 late, the last one the rest
+	long tardiness[SCHEDULER_TARDINESS_BUCKETS];
+} scheduler_deadline_stats_t;
+
+/**
+  Log-bucketed histogram of one metric. Values below 128 get a bucket each;
+  above that every power of two is split into 64 buckets, so a percentile
+  is within 1/64 of the true value in the same memory for any number of jobs.
+  Negative values, which only a scheduling bug produces, are bucketed the
+  same way by magnitude, so percentiles describe the same jobs as the sums.
+*/
+#define SCHEDULER_HISTOGRAM_BUCKETS (128 + 24 * 64)
+
+typedef struct _scheduler_histogram_t
+{
+	long count;
+	int max;
+	long buckets[SCHEDULER_HISTOGRAM_BUCKETS];
+	long negative[SCHEDULER_HISTOGRAM_BUCKETS];  //by magnitude, bucket 0 unused
+} scheduler_histogram_t;
+
+/**
+  How close the finished jobs came to their proportional share, see
+  scheduler_share_stats_r(). A job's tickets are its CFS weight, its priority
+  taken as a nice value. Its target is the tickets' fraction of the busy
+  cores while it was runnable, at most one core; the ratio is the CPU time it
+  received over that target.
+*/
+#define SCHEDULER_SHARE_CLASSES 40
+
+typedef struct _scheduler_share_stats_t
+{
+	long jobs;
+	double total_ratio;
+	double min_ratio;
+	double max_ratio;
+	//per priority class -20 to 19, priorities beyond that share the ends:
+	//jobs, CPU time received and the target time
+	long class_jobs[SCHEDULER_SHARE_CLASSES];
+	double class_received[SCHEDULER_SHARE_CLASSES];
+	double class_target[SCHEDULER_SHARE_CLASSES];
+} scheduler_share_stats_t;
+
+/**
+  One finished job, as handed to the job sink, see scheduler_job_sink_r()
+*/
+typedef struct _scheduler_job_record_t
+{
+	int job_number;
+	int arrival_time;
+	int first_start;   //time the job first ran, as its response time counts it
+	int finish_time;
+	int running_time;
+	int priority;
+	int preemptions;   //times a core was taken from the job before it finished
+	int migrations;    //times the job was put on a different core than it last ran on
+	//the CPU time the job received and the time its tickets entitle it to,
+	//as in scheduler_share_stats_t; the target is 0 if none was owed
+	int share_received;
+	double share_target;
+} scheduler_job_record_t;
+
+typedef void (*scheduler_job_sink_t)(void *context, const scheduler_job_record_t *record);
+
+/**
+  State of one scheduler. Every scheduler_*_r() function works on the
+  scheduler it is given, so independent schedulers can run side by side,
+  on different threads too. The functions without the _r suffix work on a
+  single default scheduler.
+*/
+typedef struct _scheduler_t
+{
+	scheme_t currScheme;
+	int numCores;
+
+	//jobs waiting for a core, running jobs are kept in coreJobs instead
+	priqueue_t Queue;
+
+	//per-core run queues: the queue of every core, NULL when the cores
+	//share Queue, and the next core to place a job on under round robin
+	priqueue_t *coreQueues;
+	int nextPlace;
+	scheduler_core_stats_t *coreStats;
+
+	//the job each core is running, NULL when the core is idle
+	struct _job_t **coreJobs;
+
+	//PPRI, PSJF and PEDF: the running jobs ordered by the preemption victim
+	//criteria, so the victim for a new job is at the head
+	priqueue_t Victims;
+
+	//one bit per idle core
+	unsigned long *idleCores;
+	int numIdle;
+
+	scheduler_params_t params;
+
+	//MLFQ: one FIFO queue per level, level 0 first, and one bit per level
+	//that has jobs waiting, so the next job is a find-first-set away
+	priqueue_t *levels;
+	unsigned long levelMask;
+	int nextBoost;
+
+	//CFS and STRIDE: the virtual runtime (pass) new jobs start from, and the
+	//total weight (tickets) and number of the runnable jobs, running or waiting
+	long long minVruntime;
+	long long runnableWeight;
+	int numRunnable;
+
+	//LOTTERY: the tickets of the waiting jobs in a Fenwick tree with one slot
+	//per job, so a draw finds its winner in O(log n); the job in every slot,
+	//the slots given back by the winners, and the state of the draws
+	long long *ticketTree;
+	struct _job_t **ticketJobs;
+	int *freeSlots;
+	int numFree;
+	int ticketSlots;
+	int usedSlots;
+	long long waitingTickets;
+	unsigned long long lotteryState;
+
+	//the target CPU time every ticket has been owed since start-up, and the
+	//time it was last brought up to date
+	double sharePerTicket;
+	int shareTime;
+	scheduler_share_stats_t shares;
+
+	scheduler_deadline_stats_t deadlines;
+
+	//exact sums of the metrics of the finished jobs, and their histograms,
+	//one per scheduler_metric_t
+	long long total_waiting_time;
+	long long total_response_time;
+	long long total_turnaround_time;
+	long totalJobs;
+	scheduler_histogram_t *histograms;
+
+	//called with every finished job, NULL for none
+	scheduler_job_sink_t jobSink;
+	void *jobSinkContext;
+
+	//the counters, and the job every core ran last (-1 for none) to tell
+	//context switches apart from a job getting its core back
+	scheduler_counters_t counters;
+	int *lastJobs;
+} scheduler_t;
 
 void  scheduler_start_up               (int cores, scheme_t scheme);
 int   scheduler_new_job                (int job_number, int time, int running_time, int priority);
@@ -16,8 +249,31 @@ int   scheduler_quantum_expired        (int core_id, int time);
 float scheduler_average_turnaround_time();
 float scheduler_average_waiting_time   ();
 float scheduler_average_response_time  ();
+int   scheduler_percentile             (scheduler_metric_t metric, double percentile);
+int   scheduler_max                    (scheduler_metric_t metric);
 void  scheduler_clean_up               ();
 
 void  scheduler_show_queue             ();
 
+void  scheduler_start_up_r               (scheduler_t *s, int cores, scheme_t scheme);
+void  scheduler_start_up_params_r        (scheduler_t *s, int cores, scheme_t scheme, const scheduler_params_t *params);
+int   scheduler_time_slice_r             (scheduler_t *s, int core_id);
+void  scheduler_core_stats_r             (scheduler_t *s, int core_id, scheduler_core_stats_t *stats);
+void  scheduler_job_sink_r               (scheduler_t *s, scheduler_job_sink_t sink, void *context);
+int   scheduler_counters_r               (scheduler_t *s, scheduler_counters_t *counters);
+int   scheduler_new_job_r                (scheduler_t *s, int job_number, int time, int running_time, int priority);
+int   scheduler_new_job_deadline_r       (scheduler_t *s, int job_number, int time, int running_time, int priority, int deadline);
+void  scheduler_deadline_stats_r         (scheduler_t *s, scheduler_deadline_stats_t *stats);
+void  scheduler_share_stats_r            (scheduler_t *s, scheduler_share_stats_t *stats);
+int   scheduler_job_finished_r           (scheduler_t *s, int core_id, int job_number, int time);
+int   scheduler_quantum_expired_r        (scheduler_t *s, int core_id, int time);
+float scheduler_average_turnaround_time_r(scheduler_t *s);
+float scheduler_average_waiting_time_r   (scheduler_t *s);
+float scheduler_average_response_time_r  (scheduler_t *s);
+int   scheduler_percentile_r             (scheduler_t *s, scheduler_metric_t metric, double percentile);
+int   scheduler_max_r                    (scheduler_t *s, scheduler_metric_t metric);
+void  scheduler_clean_up_r               (scheduler_t *s);
+
+void  scheduler_show_queue_r             (scheduler_t *s);
+
 #endif /* LIBSCHEDULER_H_ */
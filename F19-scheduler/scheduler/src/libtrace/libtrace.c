@@ -0,0 +1,462 @@
+/** @file libtrace.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libtrace.h"
+
+
+//counts the newlines of the contents
+static int count_lines(const char *p, const char *end)
+{
+	int lines = 0;
+	const char *nl;
+	while ((nl = memchr(p, '\n', end - p)) != NULL)
+	{
+		lines++;
+		p = nl + 1;
+	}
+	return lines;
+}
+
+//reads a whole file that cannot be mapped (a pipe, an empty file, ...)
+static char *read_all(int fd, size_t *size)
+{
+	size_t used = 0, cap = 65536;
+	char *buf = malloc(cap);
+	ssize_t n;
+	while ((n = read(fd, buf + used, cap - used)) > 0)
+	{
+		used += n;
+		if (used == cap)
+		{
+			cap *= 2;
+			buf = realloc(buf, cap);
+		}
+	}
+	if (n < 0)
+	{
+		free(buf);
+		return NULL;
+	}
+	*size = used;
+	return buf;
+}
+
+
+static uint32_t load_le32(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static void store_le32(char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+//checks the header of a binary trace, the records are left in place
+static int binary_open(trace_t *t)
+{
+	uint32_t version = load_le32(t->data + 8);
+	uint32_t columns = load_le32(t->data + 12);
+	uint64_t jobs = load_le32(t->data + 16) | ((uint64_t)load_le32(t->data + 20) << 32);
+	uint32_t flags = load_le32(t->data + 24);
+	uint32_t record_size = load_le32(t->data + 28);
+
+	uint32_t required = TRACE_COL_ARRIVAL | TRACE_COL_RUN;
+	if (version != TRACE_VERSION || (columns & required) != required ||
+	    record_size < 4 * (uint32_t)__builtin_popcount(columns) || jobs > INT_MAX ||
+	    t->size - TRACE_HEADER_SIZE < jobs * record_size)
+		return -1;
+
+	t->format = TRACE_BINARY;
+	t->columns = columns;
+	t->record_size = record_size;
+	t->sorted = (flags & TRACE_SORTED) != 0;
+	t->jobs = jobs;
+	t->cursor = t->data + TRACE_HEADER_SIZE;
+	t->end = t->cursor + jobs * record_size;
+	t->line_number = 0;
+	return 0;
+}
+
+static void csv_open(trace_t *t);
+
+
+/**
+  Opens a job trace and counts its jobs. The format is told apart by the
+  magic number at the start of binary traces; anything else is read as CSV
+  ("Arrival time","Run time","Priority", an optional "Deadline", plus a
+  header line).
+
+  The file is memory-mapped. Opening a CSV trace costs one pass of memchr
+  over the contents to count the lines; a binary trace has its job count in
+  the header, so opening it takes constant time.
+
+  @param t the trace to set up
+  @param path the file to open
+  @return 0 on success
+  @return -1 if the file cannot be opened or read, with errno set (EINVAL
+  for a binary trace with a broken header)
+ */
+int trace_open(trace_t *t, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (map != MAP_FAILED)
+	{
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		t->data = map;
+		t->size = st.st_size;
+		t->mapped = 1;
+	}
+	else
+	{
+		size_t size;
+		char *buf = read_all(fd, &size);
+		if (buf == NULL)
+		{
+			int err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		t->data = buf;
+		t->size = size;
+		t->mapped = 0;
+	}
+	close(fd);
+
+	t->last_line = NULL;
+	t->last_size = 0;
+	if (t->size >= TRACE_HEADER_SIZE && memcmp(t->data, TRACE_MAGIC, 8) == 0)
+	{
+		if (binary_open(t) < 0)
+		{
+			trace_close(t);
+			errno = EINVAL;
+			return -1;
+		}
+		return 0;
+	}
+	csv_open(t);
+	return 0;
+}
+
+
+//counts the jobs of a CSV trace and skips its header line
+static void csv_open(trace_t *t)
+{
+	const char *end = t->data + t->size;
+	int lines = count_lines(t->data, end);
+
+	// The parser stops at the '\n' closing every line instead of checking
+	// for the end of the contents, so a last line without one is copied
+	// out and terminated.
+	t->format = TRACE_CSV;
+	t->end = end;
+	while (t->end > t->data && t->end[-1] != '\n')
+		t->end--;
+	if (t->end < end)
+	{
+		size_t len = end - t->end;
+		t->last_line = malloc(len + 1);
+		memcpy(t->last_line, t->end, len);
+		t->last_line[len] = '\n';
+		t->last_size = len + 1;
+		lines++;
+	}
+	t->jobs = (lines > 0) ? lines - 1 : 0;
+
+	// Skip the header line
+	const char *nl = memchr(t->data, '\n', t->end - t->data);
+	t->cursor = (nl != NULL) ? nl + 1 : t->end;
+	if (nl == NULL)
+		t->last_size = 0;
+	t->line_number = 1;
+}
+
+
+//parses one integer column in place, surrounding blanks are allowed.
+//every loop stops at the '\n' that ends the line, so p needs no bound.
+static const char *parse_int(const char *p, int *value)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	int negative = 0;
+	if (*p == '-' || *p == '+')
+		negative = (*p++ == '-');
+
+	const char *digits = p;
+	long long v = 0;
+	while ((unsigned)(*p - '0') < 10)
+	{
+		v = v * 10 + (*p - '0');
+		if (v > INT_MAX)
+			return NULL;
+		p++;
+	}
+	if (p == digits)
+		return NULL;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	*value = negative ? -(int)v : (int)v;
+	return p;
+}
+
+
+//decodes the record of a binary trace under the cursor
+static int binary_next(trace_t *t, trace_job_t *job)
+{
+	const char *p = t->cursor;
+	if (p >= t->end)
+		return 0;
+	t->line_number++;
+
+	//columns are stored lowest bit first, a missing priority or deadline reads as 0
+	const char *col = p + 8;
+	job->arrival_time = load_le32(p);
+	job->run_time = load_le32(p + 4);
+	job->priority = 0;
+	if (t->columns & TRACE_COL_PRIORITY)
+	{
+		job->priority = load_le32(col);
+		col += 4;
+	}
+	job->deadline = (t->columns & TRACE_COL_DEADLINE) ? (int)load_le32(col) : 0;
+
+	t->cursor = p + t->record_size;
+	return 1;
+}
+
+
+/**
+  Parses the next job of the trace.
+
+  The fourth CSV column, the deadline, is optional and reads as 0 (no
+  deadline) when it is missing or empty; otherwise it must hold a number,
+  like the other columns. Columns after the fourth are ignored, and lines
+  may end in "\r\n".
+
+  @param t a trace set up by trace_open()
+  @param job filled in with the next job
+  @return 1 if a job was read
+  @return 0 at the end of the trace
+  @return -1 if the line is malformed; t->line_number is the bad line
+ */
+int trace_next(trace_t *t, trace_job_t *job)
+{
+	if (t->format == TRACE_BINARY)
+		return binary_next(t, job);
+
+	const char *p = t->cursor;
+	if (p >= t->end)
+	{
+		if (t->last_size == 0)
+			return 0;
+		p = t->last_line;
+		t->end = p + t->last_size;
+		t->last_size = 0;
+	}
+	t->line_number++;
+
+	if ((p = parse_int(p, &job->arrival_time)) == NULL || *p++ != ',' ||
+	    (p = parse_int(p, &job->run_time)) == NULL || *p++ != ',' ||
+	    (p = parse_int(p, &job->priority)) == NULL)
+		return -1;
+
+	//an empty deadline column is no deadline, anything else must be a number
+	job->deadline = 0;
+	if (*p == ',')
+	{
+		const char *q = p + 1;
+		while (*q == ' ' || *q == '\t')
+			q++;
+		if (*q == ',' || *q == '\r' || *q == '\n')
+			p = q;
+		else if ((p = parse_int(q, &job->deadline)) == NULL)
+			return -1;
+
+		//columns after the fourth are ignored
+		if (*p == ',')
+			p = memchr(p, '\n', t->end - p);
+	}
+	if (*p == '\r')
+		p++;
+	if (*p++ != '\n')
+		return -1;
+
+	t->cursor = p;
+	return 1;
+}
+
+
+/**
+  Unmaps the trace and frees everything trace_open() allocated.
+
+  @param t a trace set up by trace_open()
+ */
+void trace_close(trace_t *t)
+{
+	if (t->mapped)
+		munmap((void *)t->data, t->size);
+	else
+		free((void *)t->data);
+	free(t->last_line);
+	t->last_line = NULL;
+	t->data = NULL;
+	t->cursor = NULL;
+	t->size = 0;
+}
+
+
+//appends the decimal digits of v to p
+static char *format_int(char *p, int v)
+{
+	char digits[12];
+	unsigned int u = v;
+	int n = 0;
+	if (v < 0)
+	{
+		*p++ = '-';
+		u = -u;
+	}
+	do
+	{
+		digits[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+	while (n > 0)
+		*p++ = digits[--n];
+	return p;
+}
+
+
+/**
+  Creates a trace file to be filled in with trace_write().
+
+  @param w the writer to set up
+  @param path the file to create
+  @param format the format to write the trace in
+  @return 0 on success
+  @return -1 if the file cannot be created, with errno set
+ */
+int trace_writer_open(trace_writer_t *w, const char *path, trace_format_t format)
+{
+	w->file = fopen(path, "wb");
+	if (w->file == NULL)
+		return -1;
+	setvbuf(w->file, NULL, _IOFBF, 1 << 20);
+
+	w->format = format;
+	w->jobs = 0;
+	w->sorted = 1;
+	w->last_arrival = 0;
+
+	if (format == TRACE_BINARY)
+	{
+		//the job count and the flags are filled in by trace_writer_close()
+		char header[TRACE_HEADER_SIZE] = {0};
+		fwrite(header, 1, sizeof(header), w->file);
+	}
+	else
+	{
+		fputs("\"Arrival time\",\"Run time\",\"Priority\",\"Deadline\"\n", w->file);
+	}
+	return 0;
+}
+
+
+/**
+  Appends a job to the trace.
+
+  @param w a writer set up by trace_writer_open()
+  @param job the job to append
+  @return 0 on success
+  @return -1 if the job could not be written
+ */
+int trace_write(trace_writer_t *w, const trace_job_t *job)
+{
+	char buf[40];
+	char *p = buf;
+
+	if (w->format == TRACE_BINARY)
+	{
+		store_le32(p, job->arrival_time);
+		store_le32(p + 4, job->run_time);
+		store_le32(p + 8, job->priority);
+		store_le32(p + 12, job->deadline);
+		p += 16;
+	}
+	else
+	{
+		p = format_int(p, job->arrival_time);
+		*p++ = ',';
+		p = format_int(p, job->run_time);
+		*p++ = ',';
+		p = format_int(p, job->priority);
+		*p++ = ',';
+		p = format_int(p, job->deadline);
+		*p++ = '\n';
+	}
+
+	if (w->jobs > 0 && job->arrival_time < w->last_arrival)
+		w->sorted = 0;
+	w->last_arrival = job->arrival_time;
+	w->jobs++;
+
+	return (fwrite(buf, 1, p - buf, w->file) == (size_t)(p - buf)) ? 0 : -1;
+}
+
+
+/**
+  Finishes the trace and closes the file. For a binary trace this writes the
+  header, now that the job count is known.
+
+  @param w a writer set up by trace_writer_open()
+  @return 0 on success
+  @return -1 if the trace could not be written out completely
+ */
+int trace_writer_close(trace_writer_t *w)
+{
+	int status = 0;
+	if (w->format == TRACE_BINARY)
+	{
+		char header[TRACE_HEADER_SIZE];
+		memcpy(header, TRACE_MAGIC, 8);
+		store_le32(header + 8, TRACE_VERSION);
+		store_le32(header + 12, TRACE_COL_ARRIVAL | TRACE_COL_RUN | TRACE_COL_PRIORITY | TRACE_COL_DEADLINE);
+		store_le32(header + 16, (uint64_t)w->jobs);
+		store_le32(header + 20, (uint64_t)w->jobs >> 32);
+		store_le32(header + 24, w->sorted ? TRACE_SORTED : 0);
+		store_le32(header + 28, 16);
+
+		if (fseek(w->file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), w->file) != sizeof(header))
+			status = -1;
+	}
+	if (fclose(w->file) != 0)
+		status = -1;
+	w->file = NULL;
+	return status;
+}
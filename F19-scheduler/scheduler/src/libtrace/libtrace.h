@@ -0,0 +1,98 @@
+/** @file libtrace.h
+ */
+
+#ifndef LIBTRACE_H_
+#define LIBTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+  Formats a trace can be stored in
+*/
+typedef enum {TRACE_CSV = 0, TRACE_BINARY} trace_format_t;
+
+/**
+  Binary trace layout. A 32 byte header, every field little-endian:
+
+    offset  0  char[8]   TRACE_MAGIC
+    offset  8  uint32    TRACE_VERSION
+    offset 12  uint32    columns stored, TRACE_COL_* bits
+    offset 16  uint64    number of jobs
+    offset 24  uint32    flags, TRACE_SORTED if arrival times never decrease
+    offset 28  uint32    bytes per job record
+
+  followed by one fixed-width record per job holding a little-endian int32
+  for every column bit that is set, lowest bit first. Readers skip the
+  columns they do not know about using the record size.
+*/
+#define TRACE_MAGIC        "JOBTRACE"
+#define TRACE_VERSION      1
+#define TRACE_HEADER_SIZE  32
+
+#define TRACE_COL_ARRIVAL  0x1
+#define TRACE_COL_RUN      0x2
+#define TRACE_COL_PRIORITY 0x4
+#define TRACE_COL_DEADLINE 0x8
+
+#define TRACE_SORTED       0x1
+
+/**
+  One job of a trace, in the order of the CSV columns
+*/
+typedef struct _trace_job_t {
+	int arrival_time;
+	int run_time;
+	int priority;
+	int deadline;       //time after its arrival the job should be finished
+	                    //by, 0 if it has no deadline
+} trace_job_t;
+
+/**
+  Job trace read straight out of a memory-mapped file.
+  CSV columns are parsed in place, nothing is copied line by line, and
+  binary records are decoded where they lie.
+*/
+typedef struct _trace_t
+{
+	trace_format_t format;
+	const char *data;   //start of the file contents
+	size_t size;        //length of the file contents
+	const char *cursor; //first byte not parsed yet
+	const char *end;    //end of the lines cursor walks, the last one ends in '\n'
+	char *last_line;    //copy of a last line that has no '\n', with one added
+	size_t last_size;   //length of last_line until cursor moves over to it
+	int mapped;         //1 if data is an mmap, 0 if it was read into memory
+
+	//binary traces
+	int columns;        //TRACE_COL_* bits of the records
+	int record_size;    //bytes per record
+	int sorted;         //1 if the header promises sorted arrival times
+
+	int jobs;           //number of jobs in the trace
+	int line_number;    //line (record number for binary traces) of the last
+	                    //job returned, or of the error
+} trace_t;
+
+/**
+  Writes a trace one job at a time in either format
+*/
+typedef struct _trace_writer_t
+{
+	FILE *file;
+	trace_format_t format;
+	long jobs;          //jobs written so far
+	int sorted;         //1 while the arrival times written never decreased
+	int last_arrival;
+} trace_writer_t;
+
+int  trace_open         (trace_t *t, const char *path);
+int  trace_next         (trace_t *t, trace_job_t *job);
+void trace_close        (trace_t *t);
+
+int  trace_writer_open  (trace_writer_t *w, const char *path, trace_format_t format);
+int  trace_write        (trace_writer_t *w, const trace_job_t *job);
+int  trace_writer_close (trace_writer_t *w);
+
+#endif /* LIBTRACE_H_ */
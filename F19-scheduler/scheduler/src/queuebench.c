@@ -0,0 +1,108 @@
+/** @file queuebench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libpriqueue/libpriqueue.h"
+
+typedef struct _bench_elem_t
+{
+	int key;
+	int id;
+} bench_elem_t;
+
+int compareKey(const void * a, const void * b)
+{
+	const bench_elem_t *p = a, *q = b;
+	return(p->key - q->key);
+}
+
+//the keys run from 0 to BENCH_KEYS - 1, one bucket each
+#define BENCH_KEYS 1000
+
+int bucketKey(const void * a)
+{
+	return ((const bench_elem_t *)a)->key;
+}
+
+double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+  Offers n elements with random keys (many of them equal) and polls them all
+  back out, checking the order along the way. The bucket backend gets a
+  bucket per key.
+
+  @return 0 if the elements came out in priority order with FIFO ties
+ */
+int run(priqueue_backend_t backend, bench_elem_t *elems, int n, double *offer_ns, double *poll_ns)
+{
+	priqueue_t q;
+	if (backend == PRIQUEUE_BUCKET)
+		priqueue_init_buckets(&q, compareKey, bucketKey, BENCH_KEYS);
+	else
+		priqueue_init_backend(&q, compareKey, backend);
+
+	int i, bad = 0;
+	double start = now_seconds();
+	for (i = 0; i < n; i++)
+		priqueue_offer(&q, &elems[i]);
+	double mid = now_seconds();
+
+	bench_elem_t *prev = NULL;
+	for (i = 0; i < n; i++)
+	{
+		bench_elem_t *e = priqueue_poll(&q);
+		if (prev != NULL && (prev->key > e->key || (prev->key == e->key && prev->id > e->id)))
+			bad = 1;
+		prev = e;
+	}
+	double end = now_seconds();
+
+	priqueue_destroy(&q);
+
+	*offer_ns = (mid - start) * 1e9 / n;
+	*poll_ns = (end - mid) * 1e9 / n;
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	int max_n = (argc > 1) ? atoi(argv[1]) : 10000;
+	bench_elem_t *elems = malloc(max_n * sizeof(bench_elem_t));
+
+	srand(678);
+	int i;
+	for (i = 0; i < max_n; i++)
+	{
+		elems[i].key = rand() % BENCH_KEYS;
+		elems[i].id = i;
+	}
+
+	printf("%10s %8s %14s %14s\n", "elements", "backend", "offer (ns/op)", "poll (ns/op)");
+
+	priqueue_backend_t backends[4] = {PRIQUEUE_LIST, PRIQUEUE_HEAP, PRIQUEUE_TREE, PRIQUEUE_BUCKET};
+	const char *backend_names[4] = {"list", "heap", "tree", "bucket"};
+	int n, b, status = 0;
+	for (n = 1000; n <= max_n; n *= 10)
+	{
+		for (b = 0; b < 4; b++)
+		{
+			double offer_ns, poll_ns;
+			status |= run(backends[b], elems, n, &offer_ns, &poll_ns);
+			printf("%10d %8s %14.1f %14.1f\n", n, backend_names[b], offer_ns, poll_ns);
+		}
+	}
+
+	if (status)
+		printf("Elements were returned out of order.\n");
+
+	free(elems);
+	return status;
+}
@@ -16,6 +16,11 @@ int compare2(const void * a, const void * b)
 	return ( *(int*)b - *(int*)a );
 }
 
+int key1(const void * a)
+{
+	return *(int*)a;
+}
+
 int main()
 {
 	priqueue_t q, q2;
@@ -68,6 +73,186 @@ int main()
 	priqueue_destroy(&q2);
 	priqueue_destroy(&q);
 
+	/* Same checks against the heap backend. */
+	priqueue_init_backend(&q, compare1, PRIQUEUE_HEAP);
+	priqueue_init_backend(&q2, compare2, PRIQUEUE_HEAP);
+
+	priqueue_offer(&q, &values[12]);
+	priqueue_offer(&q, &values[13]);
+	priqueue_offer(&q, &values[14]);
+	priqueue_offer(&q, &values[12]);
+	priqueue_offer(&q, &values[12]);
+	printf("Heap total elements: %d (expected 5).\n", priqueue_size(&q));
+
+	val = *((int *)priqueue_poll(&q));
+	printf("Heap top element: %d (expected 12).\n", val);
+
+	vals_removed = priqueue_remove(&q, &values[12]);
+	printf("Heap elements removed: %d (expected 2).\n", vals_removed);
+
+	priqueue_offer(&q, &values[10]);
+	priqueue_offer(&q, &values[30]);
+	priqueue_offer(&q, &values[20]);
+	priqueue_offer(&q2, &values[10]);
+	priqueue_offer(&q2, &values[30]);
+	priqueue_offer(&q2, &values[20]);
+
+	printf("Heap elements in order queue (expected 10 13 14 20 30): ");
+	for (i = 0; i < priqueue_size(&q); i++)
+		printf("%d ", *((int *)priqueue_at(&q, i)) );
+	printf("\n");
+
+	printf("Heap remove_at(1): %d (expected 13).\n", *((int *)priqueue_remove_at(&q, 1)));
+
+	printf("Heap elements in reverse order queue (expected 30 20 10): ");
+	for (i = 0; i < priqueue_size(&q2); i++)
+		printf("%d ", *((int *)priqueue_at(&q2, i)) );
+	printf("\n");
+
+	priqueue_destroy(&q2);
+	priqueue_destroy(&q);
+
+	/* Equal elements must come back out in the order they were offered. */
+	int same[4] = {5, 5, 5, 5};
+	priqueue_init_backend(&q, compare1, PRIQUEUE_HEAP);
+	for (i = 0; i < 4; i++)
+		priqueue_offer(&q, &same[i]);
+	printf("Heap FIFO order among equal elements (expected 0 1 2 3): ");
+	for (i = 0; i < 4; i++)
+		printf("%d ", (int)((int *)priqueue_poll(&q) - same) );
+	printf("\n");
+	priqueue_destroy(&q);
+
+	/* Handles: remove and re-prioritize elements in place, on every backend. */
+	priqueue_backend_t backends[3] = {PRIQUEUE_LIST, PRIQUEUE_HEAP, PRIQUEUE_TREE};
+	const char *backend_names[3] = {"List", "Heap", "Tree"};
+	int b;
+	for (b = 0; b < 3; b++)
+	{
+		int keys[4] = {40, 10, 30, 20};
+		priqueue_handle_t handles[4];
+		priqueue_init_backend(&q, compare1, backends[b]);
+		for (i = 0; i < 4; i++)
+			handles[i] = priqueue_offer_handle(&q, &keys[i]);
+
+		priqueue_remove_handle(&q, handles[2]);
+		keys[0] = 5;
+		priqueue_update(&q, handles[0]);
+		keys[1] = 20;
+		priqueue_update(&q, handles[1]);
+
+		printf("%s handle removal and update (expected 5 20 20): ", backend_names[b]);
+		while (priqueue_size(&q) > 0)
+			printf("%d ", *((int *)priqueue_poll(&q)) );
+		printf("\n");
+		priqueue_destroy(&q);
+	}
+
+	/* Iterators: a single pass that drops the odd values, on every backend. */
+	for (b = 0; b < 3; b++)
+	{
+		priqueue_iter_t it;
+		int *v;
+		priqueue_init_backend(&q, compare1, backends[b]);
+		for (i = 9; i >= 0; i--)
+			priqueue_offer(&q, &values[i]);
+
+		for (v = priqueue_iter_begin(&q, &it); v != NULL; v = priqueue_iter_next(&it))
+			if (*v % 2)
+				priqueue_iter_remove(&it);
+
+		printf("%s iteration after removals (expected 0 2 4 6 8): ", backend_names[b]);
+		for (v = priqueue_iter_begin(&q, &it); v != NULL; v = priqueue_iter_next(&it))
+			printf("%d ", *v);
+		printf("\n");
+		priqueue_destroy(&q);
+	}
+
+	/*
+	 * The heap, the tree and the buckets must agree with the list on a long
+	 * mix of offers and removals with many equal elements, which exercises
+	 * runs of removals from the sorted snapshot of the heap, every
+	 * rebalancing case of the tree and the keys beyond the last bucket.
+	 */
+	for (b = 1; b < 4; b++)
+	{
+		priqueue_t t;
+		int mismatches = 0;
+		priqueue_init(&q, compare1);
+		if (b < 3)
+			priqueue_init_backend(&t, compare1, b == 1 ? PRIQUEUE_HEAP : PRIQUEUE_TREE);
+		else
+			priqueue_init_buckets(&t, compare1, key1, 64);
+		srand(678);
+		for (i = 0; i < 20000; i++)
+		{
+			int *v = &values[rand() % 100];
+			if (rand() % 3 == 0 && priqueue_size(&q) > 0)
+			{
+				int at = rand() % priqueue_size(&q);
+				if (priqueue_remove_at(&q, at) != priqueue_remove_at(&t, at))
+					mismatches++;
+			}
+			else
+			{
+				priqueue_offer(&q, v);
+				priqueue_offer(&t, v);
+			}
+		}
+		while (priqueue_size(&q) > 0)
+			if (priqueue_poll(&q) != priqueue_poll(&t))
+				mismatches++;
+		printf("%s mismatches against the list: %d (expected 0), %d left (expected 0).\n",
+			b < 3 ? backend_names[b] : "Bucket", mismatches, priqueue_size(&t));
+		priqueue_destroy(&t);
+		priqueue_destroy(&q);
+	}
+
+	/* Buckets keep equal elements in the order they were offered. */
+	priqueue_init_buckets(&q, compare1, key1, 8);
+	for (i = 0; i < 4; i++)
+		priqueue_offer(&q, &same[i]);
+	printf("Bucket FIFO order among equal elements (expected 0 1 2 3): ");
+	for (i = 0; i < 4; i++)
+		printf("%d ", (int)((int *)priqueue_poll(&q) - same) );
+	printf("\n");
+	priqueue_destroy(&q);
+
+	/* A destroyed queue is empty and can be used again without a fresh init. */
+	for (b = 0; b < 4; b++)
+	{
+		if (b < 3)
+			priqueue_init_backend(&q, compare1, backends[b]);
+		else
+			priqueue_init_buckets(&q, compare1, key1, 8);
+		for (i = 0; i < 40; i++)
+			priqueue_offer(&q, &values[i]);
+		priqueue_at(&q, 3);
+		priqueue_destroy(&q);
+
+		for (i = 3; i > 0; i--)
+			priqueue_offer(&q, &values[i]);
+		printf("%s reuse after destroy (expected 1 2 3): %d ", b < 3 ? backend_names[b] : "Bucket",
+			*((int *)priqueue_at(&q, 0)) );
+		priqueue_remove_at(&q, 0);
+		while (priqueue_size(&q) > 0)
+			printf("%d ", *((int *)priqueue_poll(&q)) );
+		printf("\n");
+		priqueue_destroy(&q);
+	}
+
+	/* Re-offering polled elements must recycle nodes instead of allocating. */
+	priqueue_alloc_stats_t before, after;
+	priqueue_init(&q, compare1);
+	for (i = 0; i < 50; i++)
+		priqueue_offer(&q, &values[i]);
+	priqueue_alloc_stats(&q, &before);
+	for (i = 0; i < 1000; i++)
+		priqueue_offer(&q, priqueue_poll(&q));
+	priqueue_alloc_stats(&q, &after);
+	printf("Mallocs during steady state: %ld (expected 0).\n", after.mallocs - before.mallocs);
+	priqueue_destroy(&q);
+
 	free(values);
 
 	return 0;
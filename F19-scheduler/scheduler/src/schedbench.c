@@ -0,0 +1,310 @@
+/** @file schedbench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libpriqueue/libpriqueue.h"
+#include "libscheduler/libscheduler.h"
+
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS ""
+#endif
+
+/*
+ * Every measurement runs batches of operations until it has used up its time
+ * budget, so deep queues with O(n) operations still finish quickly. Queues
+ * are filled before the clock starts, and a scheduler configuration is
+ * skipped when filling it is expected to take longer than FILL_BUDGET.
+ */
+#define MAX_DEPTH 1000000
+#define MAX_BATCH 64
+#define FILL_BUDGET 2.0
+
+//the bucket backend gets keys from 0 to BENCH_KEYS - 1, one bucket each
+#define BENCH_KEYS 1000
+
+double budget = 0.05;
+
+typedef struct _bench_elem_t
+{
+	int key;
+	int id;
+} bench_elem_t;
+
+int compareKey(const void * a, const void * b)
+{
+	const bench_elem_t *p = a, *q = b;
+	return(p->key - q->key);
+}
+
+int bucketKey(const void * a)
+{
+	return ((const bench_elem_t *)a)->key;
+}
+
+double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Measures one priqueue operation at a queue depth: every timed batch of
+ * operations starts with depth elements in the queue, and the queue is put
+ * back to that depth between batches without the clock running. Batches
+ * start at one operation and double while they are cheap, up to MAX_BATCH,
+ * so even an operation that takes a large part of the budget is timed alone.
+ * Putting a deep list back in shape costs far more than the operation being
+ * timed, so the wall clock time of a measurement is capped as well. The
+ * bucket backend is set up the way PRI and PPRI use it, with few keys
+ * shared by many elements.
+ */
+enum { OP_OFFER, OP_POLL, OP_REMOVE_AT };
+const char *op_names[] = { "offer", "poll", "remove_at" };
+
+double bench_priqueue(priqueue_backend_t backend, int op, int depth, bench_elem_t *elems, long *ops)
+{
+	priqueue_t q;
+	int keys = depth + 1;
+	if (backend == PRIQUEUE_BUCKET)
+	{
+		keys = BENCH_KEYS;
+		priqueue_init_buckets(&q, compareKey, bucketKey, BENCH_KEYS);
+	}
+	else
+		priqueue_init_backend(&q, compareKey, backend);
+
+	// Descending keys make every list offer a head insert, so filling a deep
+	// list stays linear
+	int i, k;
+	for (i = 0; i < depth; i++)
+	{
+		elems[i].key = (depth - i) % keys;
+		priqueue_offer(&q, &elems[i]);
+	}
+
+	int max_batch = (depth < MAX_BATCH) ? depth : MAX_BATCH;
+	int batch = 1;
+	bench_elem_t *taken[MAX_BATCH];
+	double elapsed = 0, wall = 0;
+	*ops = 0;
+
+	for (k = 0; k < MAX_BATCH; k++)
+		taken[k] = elems + depth + k;
+
+	while (elapsed < budget && wall < 4 * budget)
+	{
+		double start = now_seconds();
+		if (op == OP_OFFER)
+		{
+			for (k = 0; k < batch; k++)
+				priqueue_offer(&q, taken[k]);
+		}
+		else if (op == OP_POLL)
+		{
+			for (k = 0; k < batch; k++)
+				taken[k] = priqueue_poll(&q);
+		}
+		else
+		{
+			for (k = 0; k < batch; k++)
+				taken[k] = priqueue_remove_at(&q, rand() % (depth - k));
+		}
+		double spent = now_seconds() - start;
+		elapsed += spent;
+		*ops += batch;
+
+		// Back to depth elements; the elements that left the queue get fresh
+		// keys and are the ones offered next
+		if (op == OP_OFFER)
+		{
+			for (k = 0; k < batch; k++)
+				taken[k] = priqueue_poll(&q);
+		}
+		for (k = 0; k < batch; k++)
+		{
+			taken[k]->key = rand() % keys;
+			if (op != OP_OFFER)
+				priqueue_offer(&q, taken[k]);
+		}
+
+		double round = now_seconds() - start;
+		wall += round;
+		if (batch < max_batch && round < budget / 16)
+			batch *= 2;
+		if (batch > max_batch)
+			batch = max_batch;
+	}
+
+	priqueue_destroy(&q);
+	return elapsed * 1e9 / *ops;
+}
+
+/*
+ * Measures scheduling decisions at a queue depth: the cores are busy and
+ * depth jobs wait. Each step finishes the job on the next core and submits
+ * a new one, so the depth stays put; under the time-sliced schemes the step also
+ * expires the time slice of that core first. Every scheduler_* call is one decision.
+ * Jobs are due up to 1000 time units after they could have finished, so EDF
+ * and PEDF order them by a spread of deadlines.
+ */
+double bench_scheduler(scheme_t scheme, int cores, int depth, int *core_job, long *decisions)
+{
+	int job = 0, time = 0, i, k, core, run_time;
+	scheduler_t scheduler;
+
+	scheduler_start_up_r(&scheduler, cores, scheme);
+	for (i = 0; i < cores + depth; i++, job++)
+	{
+		run_time = 1 + rand() % 1000;
+		core = scheduler_new_job_deadline_r(&scheduler, job, time, run_time, rand() % 10, run_time + rand() % 1000);
+		if (core >= 0)
+			core_job[core] = job;
+	}
+
+	double elapsed = 0;
+	*decisions = 0;
+	core = 0;
+	while (elapsed < budget)
+	{
+		double start = now_seconds();
+		for (k = 0; k < MAX_BATCH; k++)
+		{
+			time++;
+			if (scheme == RR || scheme == MLFQ || scheme == CFS || scheme == STRIDE || scheme == LOTTERY)
+			{
+				core_job[core] = scheduler_quantum_expired_r(&scheduler, core, time);
+				(*decisions)++;
+			}
+			core_job[core] = scheduler_job_finished_r(&scheduler, core, core_job[core], time);
+			run_time = 1 + rand() % 1000;
+			i = scheduler_new_job_deadline_r(&scheduler, job, time, run_time, rand() % 10, run_time + rand() % 1000);
+			if (i >= 0)
+				core_job[i] = job;
+			job++;
+			*decisions += 2;
+			core = (core + 1) % cores;
+		}
+		elapsed += now_seconds() - start;
+	}
+
+	scheduler_clean_up_r(&scheduler);
+	return elapsed * 1e9 / *decisions;
+}
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-t <ms>]\n", program_name);
+	fprintf(stderr, "  -t  time budget of every measurement in milliseconds (default 50)\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Results are written to stdout as JSON, progress to stderr.\n");
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+	while ((c = getopt(argc, argv, "t:")) != -1)
+	{
+		switch (c)
+		{
+			case 't':
+				budget = atoi(optarg) / 1000.0;
+				if (budget <= 0)
+				{
+					fprintf(stderr, "Option -t <ms> requires a positive number.\n");
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	srand(678);
+	bench_elem_t *elems = malloc((MAX_DEPTH + MAX_BATCH) * sizeof(bench_elem_t));
+	int i;
+	for (i = 0; i < MAX_DEPTH + MAX_BATCH; i++)
+		elems[i].id = i;
+
+	time_t started = time(NULL);
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&started));
+
+	printf("{\n");
+	printf("  \"date\": \"%s\",\n", date);
+	printf("  \"cflags\": \"%s\",\n", BENCH_CFLAGS);
+	printf("  \"budget_ms\": %.0f,\n", budget * 1000);
+
+	/*
+	 * priqueue operations, ns per operation
+	 */
+	priqueue_backend_t backends[] = { PRIQUEUE_LIST, PRIQUEUE_HEAP, PRIQUEUE_TREE, PRIQUEUE_BUCKET };
+	const char *backend_names[] = { "list", "heap", "tree", "bucket" };
+	int b, op, depth;
+	const char *sep = "";
+
+	printf("  \"priqueue\": [");
+	for (b = 0; b < 4; b++)
+	for (op = OP_OFFER; op <= OP_REMOVE_AT; op++)
+	for (depth = 10; depth <= MAX_DEPTH; depth *= 10)
+	{
+		long ops;
+		fprintf(stderr, "priqueue %s %s %d\n", backend_names[b], op_names[op], depth);
+		double ns = bench_priqueue(backends[b], op, depth, elems, &ops);
+		printf("%s\n    {\"backend\": \"%s\", \"op\": \"%s\", \"depth\": %d, \"ns_per_op\": %.1f, \"ops\": %ld}",
+			sep, backend_names[b], op_names[op], depth, ns, ops);
+		sep = ",";
+	}
+	printf("\n  ],\n");
+
+	/*
+	 * Scheduling decisions, ns per decision
+	 */
+	scheme_t schemes[] = { FCFS, SJF, PSJF, PRI, PPRI, RR, MLFQ, CFS, EDF, PEDF, STRIDE, LOTTERY };
+	const char *scheme_names[] = { "fcfs", "sjf", "psjf", "pri", "ppri", "rr", "mlfq", "cfs", "edf", "pedf", "stride", "lottery" };
+	int core_counts[] = { 1, 4, 16, 64, 256 };
+	int s, n;
+	int *core_job = malloc(256 * sizeof(int));
+	sep = "";
+
+	printf("  \"scheduler\": [");
+	for (s = 0; s < 12; s++)
+	for (n = 0; n < 5; n++)
+	{
+		double prev_ns = 0;
+		for (depth = 10; depth <= MAX_DEPTH; depth *= 10)
+		{
+			int cores = core_counts[n];
+			printf("%s\n    {\"scheme\": \"%s\", \"cores\": %d, \"depth\": %d, ", sep, scheme_names[s], cores, depth);
+			sep = ",";
+
+			// Queue operations that are O(depth) make the fill O(depth^2);
+			// guess its cost from the previous depth
+			if (prev_ns < 0 || prev_ns * 10 * depth / 1e9 > FILL_BUDGET)
+			{
+				fprintf(stderr, "scheduler %s %d %d: skipped\n", scheme_names[s], cores, depth);
+				printf("\"ns_per_decision\": null, \"decisions\": 0}");
+				prev_ns = -1;
+				continue;
+			}
+
+			long decisions;
+			fprintf(stderr, "scheduler %s %d %d\n", scheme_names[s], cores, depth);
+			prev_ns = bench_scheduler(schemes[s], cores, depth, core_job, &decisions);
+			printf("\"ns_per_decision\": %.1f, \"decisions\": %ld}", prev_ns, decisions);
+		}
+	}
+	printf("\n  ]\n");
+	printf("}\n");
+
+	free(core_job);
+	free(elems);
+	return 0;
+}
@@ -8,278 +8,675 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "libscheduler/libscheduler.h"
+#include "libpriqueue/libpriqueue.h"
+#include "libtrace/libtrace.h"
 
 
 typedef struct _simulator_job_list_t
 {
 	int job_id, arrival_time, run_time, priority;
-	int core_id, arrived;
+	int deadline;  // relative to the arrival, 0 for none
+	int core_id;
 } simulator_job_list_t;
 
-void print_usage(char *program_name)
+/*
+ * The live jobs, those that have arrived and not yet finished, packed at the
+ * front of jobs in no particular order. A job is found by its id through an
+ * open-addressing hash table of indices into jobs, and the job a core runs
+ * through core_job, so nothing that happens in a time unit has to walk every
+ * live job. Both the array and the table grow with the most jobs ever live
+ * at once, not with the length of the trace.
+ */
+typedef struct _simulator_live_jobs_t
 {
-	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> <input file>\n", program_name);
-	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
-	fprintf(stderr, "\n");
-	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#\n");
+	simulator_job_list_t *jobs;
+	int count, capacity;
+	int *buckets;      // index into jobs, or -1 for an empty bucket
+	int bucket_bits;   // there are 1 << bucket_bits buckets
+	int bucket_mask;   // number of buckets minus one
+	int *core_job;     // index into jobs of the job each core runs, or -1
+} simulator_live_jobs_t;
+
+int live_init(simulator_live_jobs_t *live, int cores)
+{
+	int i;
+	live->count = 0;
+	live->capacity = 16;
+	live->bucket_bits = 5;
+	live->bucket_mask = 31;
+	live->jobs = malloc(live->capacity * sizeof(simulator_job_list_t));
+	live->buckets = malloc((live->bucket_mask + 1) * sizeof(int));
+	live->core_job = malloc(cores * sizeof(int));
+	if (live->jobs == NULL || live->buckets == NULL || live->core_job == NULL)
+		return 0;
+
+	for (i = 0; i <= live->bucket_mask; i++)
+		live->buckets[i] = -1;
+	for (i = 0; i < cores; i++)
+		live->core_job[i] = -1;
+	return 1;
+}
+
+void live_destroy(simulator_live_jobs_t *live)
+{
+	free(live->jobs);
+	free(live->buckets);
+	free(live->core_job);
+}
+
+/*
+ * Returns the bucket a job with id job_id starts looking from. The ids of
+ * live jobs are mostly consecutive, and would fill one long run of buckets
+ * if used as they are, so they are scattered by Fibonacci hashing.
+ */
+int live_home(const simulator_live_jobs_t *live, int job_id)
+{
+	return (int)(((unsigned int)job_id * 2654435769u) >> (32 - live->bucket_bits));
 }
 
-int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int active_jobs)
+/*
+ * Returns the bucket holding the job with id job_id, or the empty bucket
+ * where it would go.
+ */
+int live_bucket(const simulator_live_jobs_t *live, int job_id)
+{
+	int b = live_home(live, job_id);
+	while (live->buckets[b] != -1 && live->jobs[live->buckets[b]].job_id != job_id)
+		b = (b + 1) & live->bucket_mask;
+	return b;
+}
+
+/*
+ * Returns the index into live->jobs of the job with id job_id, or -1 if it
+ * is not live.
+ */
+int live_find(const simulator_live_jobs_t *live, int job_id)
+{
+	return live->buckets[live_bucket(live, job_id)];
+}
+
+/*
+ * Adds a job that just arrived. Returns its index into live->jobs, or -1 if
+ * memory runs out, in which case the live jobs are left as they were.
+ */
+int live_add(simulator_live_jobs_t *live, const simulator_job_list_t *job)
 {
 	int i;
-	for (i = 0; i < active_jobs; i++)
+	if (live->count == live->capacity)
 	{
-		if (jobs[i].job_id == job_id && jobs[i].arrived)
-		{
-			jobs[i].core_id = core_id;
-			return 1;
-		}
+		simulator_job_list_t *grown = realloc(live->jobs, 2 * live->capacity * sizeof(simulator_job_list_t));
+		if (grown == NULL)
+			return -1;
+		live->jobs = grown;
+		live->capacity *= 2;
 	}
 
-	return 0;
+	// Keep the table at most half full, so the probes stay short
+	if (2 * (live->count + 1) > live->bucket_mask + 1)
+	{
+		int buckets = 2 * (live->bucket_mask + 1);
+		int *grown = malloc(buckets * sizeof(int));
+		if (grown == NULL)
+			return -1;
+		free(live->buckets);
+		live->buckets = grown;
+		live->bucket_bits++;
+		live->bucket_mask = buckets - 1;
+		for (i = 0; i < buckets; i++)
+			live->buckets[i] = -1;
+		for (i = 0; i < live->count; i++)
+			live->buckets[live_bucket(live, live->jobs[i].job_id)] = i;
+	}
+
+	i = live->count++;
+	live->jobs[i] = *job;
+	live->buckets[live_bucket(live, job->job_id)] = i;
+	return i;
 }
 
-void print_available_jobs(simulator_job_list_t *jobs, int active_jobs)
+/*
+ * Removes the job at index i of live->jobs, which must not hold a core. The
+ * last live job takes its place.
+ */
+void live_remove(simulator_live_jobs_t *live, int i)
 {
-	printf("Active jobs are: ");
+	int b = live_bucket(live, live->jobs[i].job_id), next = b;
 
-	int i, first = 1;
-	for (i = 0; i < active_jobs; i++)
+	// Linear probing: pull back every later job of the run of full buckets
+	// that can no longer be reached past the hole
+	while (1)
 	{
-		if (jobs[i].arrived)
+		next = (next + 1) & live->bucket_mask;
+		if (live->buckets[next] == -1)
+			break;
+		int home = live_home(live, live->jobs[live->buckets[next]].job_id);
+		if (((next - home) & live->bucket_mask) >= ((next - b) & live->bucket_mask))
 		{
-			if (first)
-			{
-				printf("%d", jobs[i].job_id);
-				first = 0;
-			}
-			else
-				printf(", %d", jobs[i].job_id);
+			live->buckets[b] = live->buckets[next];
+			b = next;
 		}
 	}
+	live->buckets[b] = -1;
 
-	if (!first)
-		printf("\n");
+	int last = --live->count;
+	if (i != last)
+	{
+		live->jobs[i] = live->jobs[last];
+		live->buckets[live_bucket(live, live->jobs[i].job_id)] = i;
+		if (live->jobs[i].core_id != -1)
+			live->core_job[live->jobs[i].core_id] = i;
+	}
 }
 
-void print_available_cores(int cores)
+/*
+ * Event-driven mode (-e): rather than stepping one time unit at a time, the
+ * simulator jumps straight to the next time a job arrives, finishes or has
+ * its quantum expire. Completion and quantum events belong to a core and
+ * remember the core's epoch when they were scheduled; anything that changes
+ * what the core runs bumps the epoch and leaves the older events stale.
+ */
+enum { EVENT_ARRIVAL, EVENT_COMPLETION, EVENT_QUANTUM };
+
+typedef struct _simulator_event_t
 {
-	printf("Active cores are: ");
+	int time, type;
+	int core_id, epoch;
+} simulator_event_t;
 
-	int i;
-	for (i = 0; i < cores; i++)
+int compare_events(const void *a, const void *b)
+{
+	const simulator_event_t *p = a, *q = b;
+	return p->time - q->time;
+}
+
+void push_event(priqueue_t *events, int time, int type, int core_id, int epoch)
+{
+	simulator_event_t *event = malloc(sizeof(simulator_event_t));
+	event->time = time;
+	event->type = type;
+	event->core_id = core_id;
+	event->epoch = epoch;
+	priqueue_offer(events, event);
+}
+
+/*
+ * Returns the time of the next pending event after `time`, dropping stale
+ * and already handled events on the way, or -1 if there is none.
+ */
+int next_event_time(priqueue_t *events, int time, int *core_epoch)
+{
+	simulator_event_t *event;
+	while ((event = priqueue_peek(events)) != NULL)
 	{
-		if (i == cores - 1)
-			printf("%d\n", i);
-		else
-			printf("%d, ", i);
+		if (event->time > time && (event->type == EVENT_ARRIVAL || event->epoch == core_epoch[event->core_id]))
+			return event->time;
+		free(priqueue_poll(events));
 	}
+
+	return -1;
 }
 
+/*
+ * Timing diagram of one core, stored as runs of consecutive time units
+ * spent on the same job (or idle), so it grows with context switches rather
+ * than with simulated time. It is rendered to text only when printed.
+ */
+typedef struct _simulator_segment_t
+{
+	int job_id;  // -1 while the core is idle
+	int start, length;
+} simulator_segment_t;
 
-int main(int argc, char **argv)
+typedef struct _simulator_diagram_t
 {
-	int c;
-	int cores = 0, scheme = -1, quantum = 0;
-	char *file_name;
+	simulator_segment_t *segments;
+	int count, capacity;
+} simulator_diagram_t;
 
-	/*
-	 * Parse command line options.
-	 */
-	while ((c = getopt(argc, argv, "c:s:")) != -1)
+int diagram_append(simulator_diagram_t *diagram, int job_id, int start, int length)
+{
+	if (diagram->count > 0)
 	{
-		switch (c)
+		simulator_segment_t *last = &diagram->segments[diagram->count - 1];
+		if (last->job_id == job_id && last->start + last->length == start)
 		{
-			case 'c':
-				cores = atoi(optarg);
+			last->length += length;
+			return 1;
+		}
+	}
 
-				if (cores <= 0)
-				{
-					fprintf(stderr, "Option -c <cores> require a positive number.\n");
-					print_usage(argv[0]);
-					return 1;
-				}
-				break;
+	if (diagram->count == diagram->capacity)
+	{
+		int capacity = (diagram->capacity == 0) ? 16 : diagram->capacity * 2;
+		simulator_segment_t *grown = realloc(diagram->segments, capacity * sizeof(simulator_segment_t));
+
+		// On failure the diagram keeps its segments, and they are freed as usual
+		if (grown == NULL)
+			return 0;
+		diagram->segments = grown;
+		diagram->capacity = capacity;
+	}
 
-			case 's':
-				if (strcasecmp(optarg, "FCFS") == 0) { scheme = FCFS; }
-				else if (strcasecmp(optarg, "SJF") == 0) { scheme = SJF; }
-				else if (strcasecmp(optarg, "PSJF") == 0) { scheme = PSJF; }
-				else if (strcasecmp(optarg, "PRI") == 0) { scheme = PRI; }
-				else if (strcasecmp(optarg, "PPRI") == 0) { scheme = PPRI; }
-				else if (strncasecmp(optarg, "RR", 2) == 0)
-				{
-					scheme = RR;
-					quantum = atoi(optarg + 2);
+	simulator_segment_t *segment = &diagram->segments[diagram->count++];
+	segment->job_id = job_id;
+	segment->start = start;
+	segment->length = length;
+	return 1;
+}
 
-					if (quantum <= 0)
-					{
-						fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of RR. (Eg: -s RR2)\n");
-						print_usage(argv[0]);
-						return 1;
-					}
-				}
-				break;
+/*
+ * Writes the symbol a job is drawn with in the timing diagram.
+ */
+void job_symbol(int job_id, char *symbol)
+{
+	symbol[1] = '\0';
+
+	if (job_id < 0)
+		symbol[0] = '-';
+	else if (job_id < 10)
+		symbol[0] = job_id + '0';
+	else if (job_id < 10 + 26)
+		symbol[0] = job_id - 10 + 'a';
+	else if (job_id < 10 + 26 + 26)
+		symbol[0] = job_id - 10 - 26 + 'A';
+	else
+		snprintf(symbol, 16, "(%d)", job_id);
+}
 
-			case '?':
-				print_usage(argv[0]);
-				return 1;
+void print_diagram(int core_id, simulator_diagram_t *diagram)
+{
+	char symbol[16], line[4096];
+	int i, used = 0;
 
-			default:
-				printf("....\n");
-				break;
+	printf("  Core %2d: ", core_id);
+	for (i = 0; i < diagram->count; i++)
+	{
+		int left = diagram->segments[i].length;
+		int symbol_len;
+
+		job_symbol(diagram->segments[i].job_id, symbol);
+		symbol_len = strlen(symbol);
+
+		// Render into a local chunk and hand it to stdio a few KB at a time
+		while (left > 0)
+		{
+			if (used + symbol_len > (int)sizeof(line))
+			{
+				fwrite(line, 1, used, stdout);
+				used = 0;
+			}
+
+			if (symbol_len == 1)
+			{
+				int n = sizeof(line) - used;
+				if (n > left)
+					n = left;
+				memset(line + used, symbol[0], n);
+				used += n;
+				left -= n;
+			}
+			else
+			{
+				memcpy(line + used, symbol, symbol_len);
+				used += symbol_len;
+				left--;
+			}
 		}
 	}
+	fwrite(line, 1, used, stdout);
+	printf("\n");
+}
+
+/*
+ * Jobs are streamed from the input file in arrival order. The simulator only
+ * keeps the jobs that have arrived and not yet finished, plus one job of
+ * lookahead, rather than every job of the trace.
+ */
+typedef struct _simulator_job_reader_t
+{
+	trace_t trace;
+	const trace_job_t *shared;  // jobs already in memory (sweep mode), or NULL
+	int shared_count;
+	int jobs_read;
+	int has_next;
+	simulator_job_list_t next;
+} simulator_job_reader_t;
+
+/*
+ * Reads the next job of the trace, or of the shared job array, into
+ * reader->next.
+ *
+ * Returns 1 if a job was read, 0 at the end of the file, and -1 (after
+ * printing why) if the line is malformed or arrives before the previous job.
+ */
+int read_next_job(simulator_job_reader_t *reader)
+{
+	trace_job_t job;
+	int status;
 
-	if (cores == 0)
+	if (reader->shared != NULL)
 	{
-		fprintf(stderr, "Required option -c <cores> is not present.\n");
-		print_usage(argv[0]);
-		return 1;
+		status = (reader->jobs_read < reader->shared_count);
+		if (status)
+			job = reader->shared[reader->jobs_read];
 	}
+	else
+		status = trace_next(&reader->trace, &job);
 
-	if (scheme == -1)
+	reader->has_next = 0;
+	if (status == 0)
+		return 0;
+	if (status < 0)
 	{
-		fprintf(stderr, "Required option -s <scheme> is not present.\n");
-		print_usage(argv[0]);
-		return 1;
+		fprintf(stderr, "Illegal file format (line %d).\n", reader->trace.line_number);
+		return -1;
 	}
 
-	if (optind == argc - 1)
-		file_name = argv[optind];
-	else
+	if (reader->jobs_read > 0 && job.arrival_time < reader->next.arrival_time)
 	{
-		fprintf(stderr, "A single input file is required.\n");
-		print_usage(argv[0]);
-		return 1;
+		fprintf(stderr, "Jobs must be sorted by arrival time (line %d).\n", reader->trace.line_number);
+		return -1;
 	}
 
+	reader->next.job_id = reader->jobs_read++;
+	reader->next.arrival_time = job.arrival_time;
+	reader->next.run_time = job.run_time;
+	reader->next.priority = job.priority;
+	reader->next.deadline = job.deadline;
+	reader->next.core_id = -1;
+	reader->has_next = 1;
+	return 1;
+}
 
-	/*
-	 * Open the file, read the file, and populate the jobs data structure.
-	 */
-	FILE *file = fopen(file_name, "r");
-	if (file == NULL)
-	{
-		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
-		return 2;
-	}
+/*
+ * How much the simulator prints while it runs. All of it goes through one
+ * large stdout buffer.
+ */
+enum { VERBOSE_SUMMARY, VERBOSE_DECISIONS, VERBOSE_FULL };
 
+static char output_buffer[1 << 20];
 
-	int job_id = 0;
-	int jobs_ct = 10;
-	simulator_job_list_t* jobs = malloc(jobs_ct * sizeof(simulator_job_list_t));
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-e] [-u] [-l] [-o <file>] [-v <verbosity>] [-p <params>] -c <cores> -s <scheme> <input file>\n", program_name);
+	fprintf(stderr, "       %s -w [-e] [-u] [-l] [-j <threads>] [-p <params>] -c <core list> -s <scheme list> <input file>\n", program_name);
+	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq, cfs, edf, pedf,\n");
+	fprintf(stderr, "stride, lottery\n");
+	fprintf(stderr, "The input file is a CSV trace or a binary trace made by traceconv. A trace\n");
+	fprintf(stderr, "whose jobs have deadlines also gets the deadline misses and lateness reported.\n");
+	fprintf(stderr, "  -e  event-driven: skip ahead to the next arrival, completion or quantum expiry\n");
+	fprintf(stderr, "  -v  full (default), decisions (scheduling decisions and final averages)\n");
+	fprintf(stderr, "      summary (final averages only) or stats (final averages and the counters\n");
+	fprintf(stderr, "      of the scheduler: comparisons, queue nodes traversed and allocated,\n");
+	fprintf(stderr, "      preemptions, quantum expiries and context switches per core, all but\n");
+	fprintf(stderr, "      the allocations only counted by a build with make COUNTERS=1)\n");
+	fprintf(stderr, "  -w  sweep: run every combination of the comma separated lists given to\n");
+	fprintf(stderr, "      -s and -c, e.g. -s fcfs,sjf,rr1-20 -c 1,2,4-8, and print one table\n");
+	fprintf(stderr, "  -j  number of threads of a sweep (default: one per processor)\n");
+	fprintf(stderr, "  -u  print the utilization, migrations and steals of every core, or add\n");
+	fprintf(stderr, "      their totals to the table of a sweep\n");
+	fprintf(stderr, "  -l  print the p50, p90, p99, p99.9 and max of the waiting, turnaround and\n");
+	fprintf(stderr, "      response times, or add their p99 to the table of a sweep\n");
+	fprintf(stderr, "  -o  write a record of every job as it finishes, with the CPU time it received\n");
+	fprintf(stderr, "      against its proportional share, to a file: CSV, or JSON lines if the\n");
+	fprintf(stderr, "      name ends in .jsonl\n");
+	fprintf(stderr, "  -p  scheme tunables as name=value pairs separated by commas:\n");
+	fprintf(stderr, "      mlfq_levels (default 3), mlfq_quantum (quantum of the top level,\n");
+	fprintf(stderr, "      doubling per level, default 2), mlfq_boost (default 100),\n");
+	fprintf(stderr, "      cfs_latency (target latency, default 6), cfs_granularity (shortest\n");
+	fprintf(stderr, "      time slice, default 1), share_quantum (time slice of stride and\n");
+	fprintf(stderr, "      lottery, default 1), lottery_seed (default 1), per_core=1 (a run queue per core instead of\n");
+	fprintf(stderr, "      one shared queue), rq_place (core a new job waits on: shortest queue,\n");
+	fprintf(stderr, "      the default, or rr), rq_steal (core an idle core takes a job from:\n");
+	fprintf(stderr, "      busiest, the default, neighbor or none)\n");
+}
 
-	char line[1024 + 1];
-	fgets(line, 1024, file);  // Ignore the first (header) line
-	while (fgets(line, 1024, file) != NULL)
-	{
-		char *arrival_time = strtok(line, ",");
-		char *run_time = strtok(NULL, ",");
-		char *priority = strtok(NULL, ",");
+/*
+ * Puts the live job job_id on core core_id. The job leaves the core it ran
+ * on, if any, and the job that ran on core_id is left without a core.
+ */
+int set_active_job(int job_id, int core_id, simulator_live_jobs_t *live)
+{
+	int i = live_find(live, job_id);
+	if (i == -1)
+		return 0;
+
+	if (live->jobs[i].core_id != -1)
+		live->core_job[live->jobs[i].core_id] = -1;
+	if (live->core_job[core_id] != -1)
+		live->jobs[live->core_job[core_id]].core_id = -1;
+	live->jobs[i].core_id = core_id;
+	live->core_job[core_id] = i;
+	return 1;
+}
 
-		if (arrival_time != NULL && run_time != NULL && priority != NULL)
+void print_available_jobs(simulator_live_jobs_t *live)
+{
+	printf("Active jobs are: ");
+
+	int i, first = 1;
+	for (i = 0; i < live->count; i++)
+	{
+		if (first)
 		{
-			if (job_id == jobs_ct)
-			{
-				jobs_ct *= 2;
-				jobs = realloc(jobs, jobs_ct * sizeof(simulator_job_list_t));
+			printf("%d", live->jobs[i].job_id);
+			first = 0;
+		}
+		else
+			printf(", %d", live->jobs[i].job_id);
+	}
 
-				if (!jobs)
-				{
-					fprintf(stderr, "Out of memory.\n");
-					return 2;
-				}
-			}
+	if (!first)
+		printf("\n");
+}
 
-			jobs[job_id].job_id = job_id;
-			jobs[job_id].arrival_time = atoi(arrival_time);
-			jobs[job_id].run_time = atoi(run_time);
-			jobs[job_id].priority = atoi(priority);
-			jobs[job_id].core_id = -1;
-			jobs[job_id].arrived = 0;
+void print_available_cores(int cores)
+{
+	printf("Active cores are: ");
 
-			job_id++;
-		}
+	int i;
+	for (i = 0; i < cores; i++)
+	{
+		if (i == cores - 1)
+			printf("%d\n", i);
 		else
-		{
-			fprintf(stderr, "Illegal file format.\n");
-			return 2;
-		}
+			printf("%d, ", i);
 	}
+}
 
-	fclose(file);
 
+/*
+ * Per-job export (-o): the scheduler hands over every job as it finishes and
+ * it is written out straight away, as CSV or, for a file name ending in
+ * ".jsonl", as one JSON object per line. Nothing is kept in memory.
+ */
+typedef struct _simulator_job_export_t
+{
+	FILE *file;
+	int jsonl;
+} simulator_job_export_t;
 
-	/*
-	 * Run the simulation.
-	 */
+int open_job_export(simulator_job_export_t *export, const char *path)
+{
+	size_t len = strlen(path);
+	export->jsonl = (len >= 6 && strcmp(path + len - 6, ".jsonl") == 0);
+	export->file = fopen(path, "w");
+	if (export->file == NULL)
+		return -1;
+	setvbuf(export->file, NULL, _IOFBF, 1 << 20);
+	if (!export->jsonl)
+		fputs("job,arrival,first_start,finish,run_time,priority,preemptions,migrations,share_received,share_target\n",
+				export->file);
+	return 0;
+}
 
-	printf("Loaded %d core(s) and %d job(s) using ", cores, job_id);
-	if (scheme == FCFS) { printf("First Come First Served (FCFS)"); }
-	else if (scheme == SJF) { printf("Non-preemptive Shortest Job First (SJF)"); }
-	else if (scheme == PSJF) { printf("Preemptive Shortest Job First (PSJF)"); }
-	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
-	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
-	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
-	printf(" scheduling...\n\n");
+void export_job(void *context, const scheduler_job_record_t *r)
+{
+	simulator_job_export_t *export = context;
+	if (export->jsonl)
+		fprintf(export->file, "{\"job\":%d,\"arrival\":%d,\"first_start\":%d,\"finish\":%d,\"run_time\":%d,"
+				"\"priority\":%d,\"preemptions\":%d,\"migrations\":%d,\"share_received\":%d,\"share_target\":%.2f}\n",
+				r->job_number, r->arrival_time, r->first_start, r->finish_time, r->running_time, r->priority,
+				r->preemptions, r->migrations, r->share_received, r->share_target);
+	else
+		fprintf(export->file, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f\n", r->job_number, r->arrival_time, r->first_start,
+				r->finish_time, r->running_time, r->priority, r->preemptions, r->migrations, r->share_received,
+				r->share_target);
+}
+
+/*
+ * One simulation run: the scheduling scheme, the machine and how much to
+ * print along the way.
+ */
+typedef struct _simulator_config_t
+{
+	int scheme, cores;
+	scheduler_params_t params;  // params.quantum is the quantum of RR
+	int event_driven, verbosity;
+	int core_report;     // print the statistics of every core at the end
+	int latency_report;  // print the latency percentiles at the end
+	int stats_report;    // print the hot-path counters at the end
+	simulator_job_export_t *job_export;  // where finished jobs go, or NULL
+} simulator_config_t;
+
+typedef struct _simulator_result_t
+{
+	float waiting_time, turnaround_time, response_time;
+	double utilization;       // mean share of the run the cores were busy
+	long migrations, steals;  // totals over all cores
+	scheduler_deadline_stats_t deadlines;
+	scheduler_share_stats_t shares;
+	int latency[3][5];  // per scheduler_metric_t: p50, p90, p99, p99.9, max
+} simulator_result_t;
+
+static const double latency_percentiles[4] = { 50, 90, 99, 99.9 };
+
+/*
+ * Prints the hot-path counters of the scheduler after a run of jobs jobs:
+ * the work of its queues, preemptions, quantum expiries and the context
+ * switches of every core. Only the allocations are counted unless the
+ * simulator was built with make COUNTERS=1.
+ */
+void print_scheduler_counters(scheduler_t *scheduler, int cores, long jobs)
+{
+	scheduler_counters_t counters;
+	int i, enabled = scheduler_counters_r(scheduler, &counters);
+	double per_job = (jobs > 0) ? 1.0 / jobs : 0;
+
+	printf("SCHEDULER COUNTERS:\n");
+	if (!enabled)
+		printf("  (compiled out, rebuild with make clean && make COUNTERS=1 to count them)\n");
+	printf("  Comparisons:      %12ld (%.2f per job)\n", counters.queues.compares, counters.queues.compares * per_job);
+	printf("  Nodes Traversed:  %12ld (%.2f per job)\n", counters.queues.traversed, counters.queues.traversed * per_job);
+	printf("  Node Allocations: %12ld (%ld mallocs, %ld recycled)\n", counters.alloc.nodes, counters.alloc.mallocs,
+			counters.alloc.recycled);
+	printf("  Preemptions:      %12ld (%.2f per job)\n", counters.preemptions, counters.preemptions * per_job);
+	printf("  Quantum Expiries: %12ld (%.2f per job)\n", counters.quantum_expiries, counters.quantum_expiries * per_job);
+	printf("  Context Switches: %12ld (%.2f per job)\n", counters.context_switches, counters.context_switches * per_job);
+	for (i = 0; i < cores; i++)
+	{
+		scheduler_core_stats_t stats;
+		scheduler_core_stats_r(scheduler, i, &stats);
+		printf("    Core %2d:        %12ld\n", i, stats.context_switches);
+	}
+	printf("\n");
+}
+
+/*
+ * Runs the jobs of the reader, which must already hold its first job,
+ * through a scheduler of its own. Everything the run prints is governed by
+ * config->verbosity except errors.
+ *
+ * Returns 0 and fills in result on success, 2 if the input turns out to be
+ * broken and 3 if the scheduler made an invalid decision.
+ */
+int simulate(const simulator_config_t *config, simulator_job_reader_t *reader, simulator_result_t *result)
+{
+	int cores = config->cores, scheme = config->scheme;
+	int event_driven = config->event_driven, verbosity = config->verbosity;
+	scheduler_t scheduler;
+
+	// Under the time-sliced schemes every job gets a time slice from the
+	// scheduler when it is put on a core
+	int time_sliced = (scheme == RR || scheme == MLFQ || scheme == CFS || scheme == STRIDE || scheme == LOTTERY);
 
-	scheduler_start_up(cores, scheme);
+	scheduler_start_up_params_r(&scheduler, cores, scheme, &config->params);
+	if (config->job_export != NULL)
+		scheduler_job_sink_r(&scheduler, export_job, config->job_export);
 
 
-	int time = 0, i, j;
-	int active_jobs = job_id, jobs_alive = 0;
+	int time = 0, i, status = 0;
+	simulator_live_jobs_t live;
 
 	int *quantum_clock = malloc(cores * sizeof(int));
-	char **core_timing_diagram = malloc(cores * sizeof(char *));
-	int core_timing_diagram_size = 1024;
+	simulator_diagram_t *core_timing_diagram = calloc(cores, sizeof(simulator_diagram_t));
 
 	for (i = 0; i < cores; i++)
 	{
 		quantum_clock[i] = -1;
-		core_timing_diagram[i] = malloc(core_timing_diagram_size + 1);
-		core_timing_diagram[i][0] = '\0';
 	}
 
-	while (active_jobs > 0)
+	// Event-driven mode: which cores changed job this time unit, and their epochs
+	priqueue_t events;
+	int *core_dirty = calloc(cores, sizeof(int));
+	int *core_epoch = calloc(cores, sizeof(int));
+
+	priqueue_init_backend(&events, compare_events, PRIQUEUE_HEAP);
+	if (event_driven && reader->has_next)
+		push_event(&events, reader->next.arrival_time, EVENT_ARRIVAL, -1, 0);
+
+	if (!live_init(&live, cores))
+	{
+		fprintf(stderr, "Out of memory.\n");
+		status = 2;
+		goto done;
+	}
+
+	while (live.count > 0 || reader->has_next)
 	{
-		printf("=== [TIME %d] ===\n", time);
+		if (verbosity == VERBOSE_FULL)
+			printf("=== [TIME %d] ===\n", time);
 
 		/*
-		 * 1. Check if any jobs finished in the last time unit.
+		 * 1. Check if any jobs finished in the last time unit.  Jobs that
+		 *    finish together reach the scheduler in the order of their cores.
 		 */
-		for (i = 0; i < active_jobs; i++)
+		for (i = 0; i < cores; i++)
 		{
-			if (jobs[i].run_time == 0)
+			int k = live.core_job[i];
+			if (k != -1 && live.jobs[k].run_time <= 0)
 			{
 				// Notify the scheduler has finished
-				int job_id = jobs[i].job_id;
-				int core_id = jobs[i].core_id;
-				int new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
+				int job_id = live.jobs[k].job_id;
+				int core_id = i;
+				int new_job_id = scheduler_job_finished_r(&scheduler, core_id, job_id, time);
+				core_dirty[core_id] = 1;
 
-				if (scheme == RR)
-					quantum_clock[jobs[i].core_id] = quantum;
+				if (time_sliced)
+					quantum_clock[core_id] = scheduler_time_slice_r(&scheduler, core_id);
 
-				// Delete the finished jobs, decrease the number of active jobs
-				if (i != active_jobs - 1)
-					memcpy(&jobs[i], &jobs[active_jobs - 1], sizeof(simulator_job_list_t));
-				active_jobs--;
-				jobs_alive--;
-				i--;
+				// Delete the finished job, decrease the number of active jobs
+				live.jobs[k].core_id = -1;
+				live.core_job[core_id] = -1;
+				live_remove(&live, k);
 
 				// Set the new job
-				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
+				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, &live) )
 				{
 					printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
-					print_available_jobs(jobs, active_jobs);
-					return 3;
+					print_available_jobs(&live);
+					status = 3;
+					goto done;
 				}
-				else
+				else if (verbosity >= VERBOSE_DECISIONS)
 				{
 					printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+					if (verbosity == VERBOSE_FULL) { printf("  Queue: "); scheduler_show_queue_r(&scheduler); printf("\n\n"); }
 				}
 			}
 		}
@@ -287,46 +684,42 @@ int main(int argc, char **argv)
 		/*
 		 * Check to see if we finished our last job.  (If we don't check here, we would run an extra time unit that will be totally idle.)
 		 */
-		if (active_jobs == 0)
+		if (live.count == 0 && !reader->has_next)
 			break;
 
 		/*
 		 * 2. Check of any quantums expired in the last time unit.
 		 */
-		if (scheme == RR)
+		if (time_sliced)
 		{
 			for (i = 0; i < cores; i++)
 			{
-				if (quantum_clock[i] == 0)
+				int k = live.core_job[i];
+				if (quantum_clock[i] == 0 && k != -1)
 				{
-					for (j = 0; j < active_jobs; j++)
+					// Notify the scheduler the quantum has expired
+					int core_id = i;
+					int old_job_id = live.jobs[k].job_id;
+					int new_job_id = scheduler_quantum_expired_r(&scheduler, core_id, time);
+
+					live.jobs[k].core_id = -1;
+					live.core_job[core_id] = -1;
+
+					quantum_clock[core_id] = scheduler_time_slice_r(&scheduler, core_id);
+					core_dirty[core_id] = 1;
+
+					// Set the new job
+					if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, &live) )
+					{
+						printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
+						print_available_jobs(&live);
+						status = 3;
+						goto done;
+					}
+					else if (verbosity >= VERBOSE_DECISIONS)
 					{
-						if (jobs[j].core_id == i)
-						{
-							// Notify the scheduler the quantum has expired
-							int core_id = jobs[j].core_id;
-							int old_job_id = jobs[j].job_id;
-							int new_job_id = scheduler_quantum_expired(jobs[j].core_id, time);
-
-							jobs[j].core_id = -1;
-
-							quantum_clock[core_id] = quantum;
-
-							// Set the new job
-							if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-							{
-								printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
-								print_available_jobs(jobs, active_jobs);
-								return 3;
-							}
-							else
-							{
-								printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
-								printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-							}
-
-							break;
-						}
+						printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
+						if (verbosity == VERBOSE_FULL) { printf("  Queue: "); scheduler_show_queue_r(&scheduler); printf("\n\n"); }
 					}
 				}
 			}
@@ -336,118 +729,126 @@ int main(int argc, char **argv)
 		/*
 		 * 3. Check for any new jobs that arrive in this time unit
 		 */
-		for (i = 0; i < active_jobs; i++)
+		while (reader->has_next && reader->next.arrival_time <= time)
 		{
-			if (jobs[i].arrival_time == time)
+			i = live_add(&live, &reader->next);
+			if (i == -1)
 			{
-				int new_job_core_id = scheduler_new_job(jobs[i].job_id, time, jobs[i].run_time, jobs[i].priority);
-				jobs[i].arrived = 1;
-				jobs_alive++;
+				fprintf(stderr, "Out of memory.\n");
+				status = 2;
+				goto done;
+			}
+			simulator_job_list_t *job = &live.jobs[i];
 
-				if (new_job_core_id >= 0 && new_job_core_id < cores)
-				{
-					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id, new_job_core_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+			if (read_next_job(reader) < 0)
+			{
+				status = 2;
+				goto done;
+			}
+			if (event_driven && reader->has_next)
+				push_event(&events, reader->next.arrival_time, EVENT_ARRIVAL, -1, 0);
 
-					// Find if anyone is currently using the core.
-					for (j = 0; j < active_jobs; j++)
-						if (jobs[j].core_id == new_job_core_id)
-							jobs[j].core_id = -1;
+			int new_job_core_id = scheduler_new_job_deadline_r(&scheduler, job->job_id, time, job->run_time,
+					job->priority, job->deadline);
 
-					// Assign the core to the new job
-					jobs[i].core_id = new_job_core_id;
+			if (new_job_core_id >= 0 && new_job_core_id < cores)
+			{
+				if (verbosity >= VERBOSE_DECISIONS)
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
+							job->job_id, job->run_time, job->priority, job->job_id, new_job_core_id);
+				if (verbosity == VERBOSE_FULL) { printf("  Queue: "); scheduler_show_queue_r(&scheduler); printf("\n\n"); }
 
-					if (scheme == RR)
-						quantum_clock[new_job_core_id] = quantum;
-				}
-				else if (new_job_core_id == -1)
-				{
+				// Assign the core to the new job, whoever was using it goes without
+				set_active_job(job->job_id, new_job_core_id, &live);
+				core_dirty[new_job_core_id] = 1;
+
+				if (time_sliced)
+					quantum_clock[new_job_core_id] = scheduler_time_slice_r(&scheduler, new_job_core_id);
+			}
+			else if (new_job_core_id == -1)
+			{
+				if (verbosity >= VERBOSE_DECISIONS)
 					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-				}
-				else
-				{
-					printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
-					print_available_cores(cores);
-					return 3;
-				}
+							job->job_id, job->run_time, job->priority, job->job_id);
+				if (verbosity == VERBOSE_FULL) { printf("  Queue: "); scheduler_show_queue_r(&scheduler); printf("\n\n"); }
+			}
+			else
+			{
+				printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
+				print_available_cores(cores);
+				status = 3;
+				goto done;
 			}
 		}
 
 
 		/*
-		 * 4. Run the time unit.
+		 * 4. Run the time unit.  In event-driven mode, run every time unit up
+		 *    to the next event at once: nothing changes in between.
 		 */
-		char time_string[cores][11];
 		int cores_working = 0;
+		int span = 1;
 
-		for (i = 0; i < cores; i++)
-			time_string[i][0] = '\0';
-
-		for (i = 0; i < active_jobs; i++)
+		if (event_driven)
 		{
-			if (jobs[i].core_id != -1)
+			// Only the cores that changed job get events, straight from core_job
+			for (i = 0; i < cores; i++)
 			{
-				cores_working++;
-				jobs[i].run_time--;
-				quantum_clock[jobs[i].core_id]--;
-
-				assert(time_string[jobs[i].core_id][0] == '\0');
-
-				if (jobs[i].job_id < 10)
-					sprintf(time_string[jobs[i].core_id], "%d", jobs[i].job_id);
-				else if (jobs[i].job_id < 10 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 + 'a');
-				else if (jobs[i].job_id < 10 + 26 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 - 26 + 'A');
-				else
-					snprintf(time_string[jobs[i].core_id], 10, "(%d)", jobs[i].job_id);
+				int k = live.core_job[i];
+				if (k != -1 && core_dirty[i])
+				{
+					core_epoch[i]++;
+					push_event(&events, time + (live.jobs[k].run_time > 0 ? live.jobs[k].run_time : 1), EVENT_COMPLETION, i, core_epoch[i]);
+					if (time_sliced)
+						push_event(&events, time + quantum_clock[i], EVENT_QUANTUM, i, core_epoch[i]);
+				}
+				core_dirty[i] = 0;
 			}
+
+			int next_time = next_event_time(&events, time, core_epoch);
+			if (next_time > time)
+				span = next_time - time;
 		}
 
+		// Idle cores are recorded with a job id of -1
 		for (i = 0; i < cores; i++)
 		{
-			// If the core is idle, print a '-'
-			if (time_string[i][0] == '\0')
-				strcpy(time_string[i], "-");
-
-			// Ensure we have enough memory
-			while (strlen(core_timing_diagram[i]) + strlen(time_string[i]) >= (unsigned int)core_timing_diagram_size)
+			int k = live.core_job[i], job_id = -1;
+			if (k != -1)
 			{
-				core_timing_diagram_size *= 2;
-
-				for (j = 0; j < cores; j++)
-				{
-					core_timing_diagram[j] = realloc(core_timing_diagram[j], core_timing_diagram_size + 1);
-
-					if (core_timing_diagram[j] == NULL)
-					{
-						fprintf(stderr, "Out of memory.\n");
-						return 3;
-					}
-				}
+				assert(live.jobs[k].core_id == i);
+				cores_working++;
+				live.jobs[k].run_time -= span;
+				quantum_clock[i] -= span;
+				job_id = live.jobs[k].job_id;
 			}
 
-			strcat( core_timing_diagram[i], time_string[i] );
+			if (!diagram_append(&core_timing_diagram[i], job_id, time, span))
+			{
+				fprintf(stderr, "Out of memory.\n");
+				status = 3;
+				goto done;
+			}
 		}
 
 
 		/*
 		 * 5. Print data!
 		 */
-		printf("At the end of time unit %d...\n", time);
+		if (verbosity == VERBOSE_FULL)
+		{
+			printf("At the end of time unit %d...\n", time + span - 1);
 
-		for (i = 0; i < cores; i++)
-			printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+			for (i = 0; i < cores; i++)
+				print_diagram(i, &core_timing_diagram[i]);
 
-		printf("\n");
+			printf("\n");
 
-		printf("  Queue: ");
-		scheduler_show_queue();
-		printf("\n");
-		printf("\n");
+			printf("  Queue: ");
+			scheduler_show_queue_r(&scheduler);
+			printf("\n");
+			printf("\n");
+		}
 
 
 		/*
@@ -455,38 +856,734 @@ int main(int argc, char **argv)
 		 *
 		 * - If there's a job alive (needing to be ran) and all CPUs are idle, the scheduler failed to schedule properly.
 		 */
-		if (jobs_alive > 0 && cores_working == 0)
+		if (live.count > 0 && cores_working == 0)
 		{
 			printf("All cores are idle and at least one job remains unscheduled.\n");
-			print_available_jobs(jobs, active_jobs);
-			return 3;
+			print_available_jobs(&live);
+			status = 3;
+			goto done;
 		}
 
 
 		/*
 		 * 7. Increase time
 		 */
-		time++;
+		time += span;
 	}
 
 
-	printf("FINAL TIMING DIAGRAM:\n");
-	for (i = 0; i < cores; i++)
-		printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+	if (verbosity == VERBOSE_FULL)
+	{
+		printf("FINAL TIMING DIAGRAM:\n");
+		for (i = 0; i < cores; i++)
+			print_diagram(i, &core_timing_diagram[i]);
 
-	printf("\n");
-	printf("Average Waiting Time: %.2f\n", scheduler_average_waiting_time());
-	printf("Average Turnaround Time: %.2f\n", scheduler_average_turnaround_time());
-	printf("Average Response Time: %.2f\n", scheduler_average_response_time());
+		printf("\n");
+	}
+	result->utilization = 0;
+	result->migrations = 0;
+	result->steals = 0;
+	if (config->core_report)
+		printf("CORE STATISTICS:\n");
+	for (i = 0; i < cores; i++)
+	{
+		scheduler_core_stats_t stats;
+		scheduler_core_stats_r(&scheduler, i, &stats);
+		double utilization = (time > 0) ? (double)stats.busy_time / time : 0;
+		result->utilization += utilization / cores;
+		result->migrations += stats.migrations;
+		result->steals += stats.steals;
+		if (config->core_report)
+			printf("  Core %2d: %6.2f%% busy, %ld dispatches, %ld migrations, %ld steals\n",
+					i, 100 * utilization, stats.dispatches, stats.migrations, stats.steals);
+	}
+	if (config->core_report)
+		printf("  Total:   %6.2f%% busy, %ld migrations, %ld steals\n\n",
+				100 * result->utilization, result->migrations, result->steals);
+
+	result->waiting_time = scheduler_average_waiting_time_r(&scheduler);
+	result->turnaround_time = scheduler_average_turnaround_time_r(&scheduler);
+	result->response_time = scheduler_average_response_time_r(&scheduler);
+	scheduler_deadline_stats_r(&scheduler, &result->deadlines);
+	scheduler_share_stats_r(&scheduler, &result->shares);
+
+	static const char *metric_names[3] = { "Waiting:", "Turnaround:", "Response:" };
+	if (config->latency_report)
+		printf("LATENCY PERCENTILES:\n  %-12s %9s %9s %9s %9s %9s\n", "", "p50", "p90", "p99", "p99.9", "max");
+	for (i = 0; i < 3; i++)
+	{
+		int k;
+		for (k = 0; k < 4; k++)
+			result->latency[i][k] = scheduler_percentile_r(&scheduler, i, latency_percentiles[k]);
+		result->latency[i][4] = scheduler_max_r(&scheduler, i);
+		if (config->latency_report)
+			printf("  %-12s %9d %9d %9d %9d %9d\n", metric_names[i], result->latency[i][0], result->latency[i][1],
+					result->latency[i][2], result->latency[i][3], result->latency[i][4]);
+	}
+	if (config->latency_report)
+		printf("\n");
+	if (config->stats_report)
+		print_scheduler_counters(&scheduler, cores, scheduler.totalJobs);
 
-	scheduler_clean_up();
+	// Errors leave the run early through here, everything is freed alike
+done:
+	scheduler_clean_up_r(&scheduler);
 
 
+	simulator_event_t *event;
+	while ((event = priqueue_poll(&events)) != NULL)
+		free(event);
+	priqueue_destroy(&events);
+	free(core_dirty);
+	free(core_epoch);
 	free(quantum_clock);
 	for (i=0; i < cores; i++)
-		free(core_timing_diagram[i]);
+		free(core_timing_diagram[i].segments);
 	free(core_timing_diagram);
+	live_destroy(&live);
+
+	return status;
+}
+
+/*
+ * Prints how the jobs with a deadline fared: the share that missed it, the
+ * lateness (finish time minus deadline) and how late the missed jobs were,
+ * in power-of-two ranges.
+ */
+void print_deadline_stats(const scheduler_deadline_stats_t *d)
+{
+	printf("\nDeadline Miss Rate: %.2f%% (%ld of %ld jobs)\n", 100.0 * d->misses / d->jobs, d->misses, d->jobs);
+	printf("Average Lateness: %.2f\n", (double)d->total_lateness / d->jobs);
+	printf("Lateness Range: %lld to %lld\n", d->min_lateness, d->max_lateness);
+	if (d->misses == 0)
+		return;
+
+	printf("Tardiness of Missed Jobs:\n");
+	int i;
+	for (i = 0; i < SCHEDULER_TARDINESS_BUCKETS; i++)
+	{
+		if (d->tardiness[i] == 0)
+			continue;
+		char range[32];
+		long long low = 1LL << i;
+		if (i == 0)
+			snprintf(range, sizeof(range), "1");
+		else if (i == SCHEDULER_TARDINESS_BUCKETS - 1)
+			snprintf(range, sizeof(range), "%lld+", low);
+		else
+			snprintf(range, sizeof(range), "%lld-%lld", low, 2 * low - 1);
+		printf("  %12s: %ld (%.2f%%)\n", range, d->tardiness[i], 100.0 * d->tardiness[i] / d->misses);
+	}
+}
+
+/*
+ * Prints how close the jobs came to the CPU time their tickets entitle them
+ * to, per job and per priority class.
+ */
+void print_share_stats(const scheduler_share_stats_t *sh)
+{
+	if (sh->jobs == 0)
+		return;
+	printf("\nCPU Share Received / Target: mean %.2f, min %.2f, max %.2f per job\n",
+			sh->total_ratio / sh->jobs, sh->min_ratio, sh->max_ratio);
+	printf("  %8s %10s %15s %15s %8s\n", "priority", "jobs", "received", "target", "ratio");
+	int i;
+	for (i = 0; i < SCHEDULER_SHARE_CLASSES; i++)
+		if (sh->class_jobs[i] > 0)
+			printf("  %8d %10ld %15.0f %15.0f %8.2f\n", i - 20, sh->class_jobs[i],
+					sh->class_received[i], sh->class_target[i], sh->class_received[i] / sh->class_target[i]);
+}
+
+/*
+ * Parses a scheme name: fcfs, sjf, psjf, pri, ppri, rr#, mlfq, cfs, edf, pedf,
+ * stride or lottery (case does not matter). Returns 0, -1 if the name is not a scheme, or -2 if it is RR
+ * without a positive quantum.
+ */
+int parse_scheme(const char *name, int *scheme, int *quantum)
+{
+	*quantum = 0;
+	if (strcasecmp(name, "FCFS") == 0) { *scheme = FCFS; }
+	else if (strcasecmp(name, "SJF") == 0) { *scheme = SJF; }
+	else if (strcasecmp(name, "PSJF") == 0) { *scheme = PSJF; }
+	else if (strcasecmp(name, "PRI") == 0) { *scheme = PRI; }
+	else if (strcasecmp(name, "PPRI") == 0) { *scheme = PPRI; }
+	else if (strcasecmp(name, "MLFQ") == 0) { *scheme = MLFQ; }
+	else if (strcasecmp(name, "CFS") == 0) { *scheme = CFS; }
+	else if (strcasecmp(name, "EDF") == 0) { *scheme = EDF; }
+	else if (strcasecmp(name, "PEDF") == 0) { *scheme = PEDF; }
+	else if (strcasecmp(name, "STRIDE") == 0) { *scheme = STRIDE; }
+	else if (strcasecmp(name, "LOTTERY") == 0) { *scheme = LOTTERY; }
+	else if (strncasecmp(name, "RR", 2) == 0)
+	{
+		*scheme = RR;
+		*quantum = atoi(name + 2);
+		if (*quantum <= 0)
+			return -2;
+	}
+	else
+		return -1;
+	return 0;
+}
+
+const char *scheme_name(int scheme)
+{
+	static const char *names[] = { "fcfs", "sjf", "psjf", "pri", "ppri", "rr", "mlfq", "cfs", "edf", "pedf", "stride", "lottery" };
+	return names[scheme];
+}
+
+/*
+ * Parses the scheme tunables of -p, e.g. "mlfq_levels=4,mlfq_boost=50",
+ * into params. The run queue policies take names, e.g. "rq_steal=none".
+ * Returns 0, or -1 if a name is unknown or a value is not a positive number
+ * or a known policy.
+ */
+int parse_params(const char *list, scheduler_params_t *params)
+{
+	while (*list != '\0')
+	{
+		const char *end = strchr(list, ',');
+		int len = (end != NULL) ? end - list : (int)strlen(list);
+		const char *eq = memchr(list, '=', len);
+		if (eq == NULL)
+			return -1;
+
+		static const char *const place_names[] = { "shortest", "rr", NULL };
+		static const char *const steal_names[] = { "busiest", "neighbor", "none", NULL };
+		const char *const *names = NULL;  // the values of a policy, in enum order
+		int *field;
+		int name_len = eq - list;
+		if (name_len == 11 && strncmp(list, "mlfq_levels", 11) == 0) { field = &params->mlfq_levels; }
+		else if (name_len == 12 && strncmp(list, "mlfq_quantum", 12) == 0) { field = &params->mlfq_quantum; }
+		else if (name_len == 10 && strncmp(list, "mlfq_boost", 10) == 0) { field = &params->mlfq_boost; }
+		else if (name_len == 11 && strncmp(list, "cfs_latency", 11) == 0) { field = &params->cfs_latency; }
+		else if (name_len == 15 && strncmp(list, "cfs_granularity", 15) == 0) { field = &params->cfs_granularity; }
+		else if (name_len == 13 && strncmp(list, "share_quantum", 13) == 0) { field = &params->share_quantum; }
+		else if (name_len == 12 && strncmp(list, "lottery_seed", 12) == 0) { field = &params->lottery_seed; }
+		else if (name_len == 8 && strncmp(list, "per_core", 8) == 0) { field = &params->per_core; }
+		else if (name_len == 8 && strncmp(list, "rq_place", 8) == 0) { field = &params->rq_place; names = place_names; }
+		else if (name_len == 8 && strncmp(list, "rq_steal", 8) == 0) { field = &params->rq_steal; names = steal_names; }
+		else
+			return -1;
+
+		if (names != NULL)
+		{
+			int k, value_len = len - name_len - 1;
+			*field = 0;
+			for (k = 0; names[k] != NULL; k++)
+				if ((int)strlen(names[k]) == value_len && strncasecmp(eq + 1, names[k], value_len) == 0)
+					*field = k + 1;
+		}
+		else
+			*field = atoi(eq + 1);
+		if (*field <= 0)
+			return -1;
+		list = (end != NULL) ? end + 1 : list + len;
+	}
+	return 0;
+}
+
+/*
+ * Sweep mode (-w) runs every combination of a list of schemes and a list of
+ * core counts. The trace is parsed once into memory and shared read-only by
+ * a pool of worker threads, each of which takes the next configuration,
+ * runs it with a scheduler of its own and stores the averages.
+ */
+typedef struct _simulator_sweep_t
+{
+	const trace_job_t *jobs;
+	int job_count;
+
+	simulator_config_t *configs;
+	simulator_result_t *results;
+	int *status;
+	int count;
+
+	int next;  // next configuration to hand out, guarded by lock
+	pthread_mutex_t lock;
+} simulator_sweep_t;
+
+void *sweep_worker(void *arg)
+{
+	simulator_sweep_t *sweep = arg;
+
+	while (1)
+	{
+		pthread_mutex_lock(&sweep->lock);
+		int i = sweep->next++;
+		pthread_mutex_unlock(&sweep->lock);
+		if (i >= sweep->count)
+			break;
+
+		simulator_job_reader_t reader;
+		reader.shared = sweep->jobs;
+		reader.shared_count = sweep->job_count;
+		reader.jobs_read = 0;
+		read_next_job(&reader);
+
+		sweep->status[i] = simulate(&sweep->configs[i], &reader, &sweep->results[i]);
+	}
+
+	return NULL;
+}
+
+/*
+ * Splits a sweep list such as "1,2,8-16" or "fcfs,rr1-4" into its items.
+ * Every item is either a single value or a range FIRST-LAST; the text
+ * before the number (the scheme name) is returned in prefix.
+ *
+ * Returns the number of characters consumed, or 0 at the end of the list.
+ */
+int next_list_item(const char *list, char *prefix, int prefix_size, int *first, int *last)
+{
+	const char *end = strchr(list, ',');
+	int len = (end != NULL) ? end - list : (int)strlen(list);
+	if (len == 0)
+		return 0;
+
+	int p = 0;
+	while (p < len && (list[p] < '0' || list[p] > '9'))
+		p++;
+	snprintf(prefix, prefix_size, "%.*s", p, list);
+
+	*first = *last = (p < len) ? atoi(list + p) : 0;
+	const char *dash = memchr(list + p, '-', len - p);
+	if (dash != NULL)
+		*last = atoi(dash + 1);
+
+	return (end != NULL) ? len + 1 : len;
+}
+
+/*
+ * Builds the configurations of a sweep from its scheme and core lists.
+ *
+ * Returns the number of configurations, or -1 after printing what is wrong
+ * with the lists.
+ */
+int build_sweep(const char *schemes, const char *cores, const scheduler_params_t *params, int event_driven, simulator_config_t **configs)
+{
+	int count = 0, capacity = 16;
+	*configs = malloc(capacity * sizeof(simulator_config_t));
+
+	const char *s = schemes;
+	int n;
+	char name[32];
+	int first, last;
+
+	while ((n = next_list_item(s, name, sizeof(name), &first, &last)) > 0)
+	{
+		s += n;
+
+		int scheme, quantum, q;
+		char single[48];
+		snprintf(single, sizeof(single), "%s%d", name, first);
+		if ((parse_scheme(name, &scheme, &quantum) == -1 && parse_scheme(single, &scheme, &quantum) < 0) ||
+		    (scheme == RR && (first <= 0 || last < first)))
+		{
+			fprintf(stderr, "Invalid scheme in the sweep list \"%s\".\n", schemes);
+			return -1;
+		}
+		if (scheme != RR)
+			first = last = 0;
+
+		for (q = first; q <= last; q++)
+		{
+			const char *c = cores;
+			int m, cfirst, clast, k;
+			char unused[8];
+
+			while ((m = next_list_item(c, unused, sizeof(unused), &cfirst, &clast)) > 0)
+			{
+				c += m;
+				if (unused[0] != '\0' || cfirst <= 0 || clast < cfirst)
+				{
+					fprintf(stderr, "Invalid core count in the sweep list \"%s\".\n", cores);
+					return -1;
+				}
+
+				for (k = cfirst; k <= clast; k++)
+				{
+					if (count == capacity)
+					{
+						capacity *= 2;
+						*configs = realloc(*configs, capacity * sizeof(simulator_config_t));
+					}
+					simulator_config_t *config = &(*configs)[count++];
+					config->scheme = scheme;
+					config->params = *params;
+					config->params.quantum = q;
+					config->cores = k;
+					config->event_driven = event_driven;
+					config->verbosity = VERBOSE_SUMMARY;
+					config->core_report = 0;
+					config->latency_report = 0;
+					config->stats_report = 0;
+					config->job_export = NULL;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Runs a sweep over the trace in file_name on threads worker threads and
+ * prints one row of averages per configuration.
+ */
+int run_sweep(const char *file_name, const char *schemes, const char *cores, const scheduler_params_t *params, int event_driven, int core_report, int latency_report, int threads)
+{
+	simulator_config_t *configs;
+	int count = build_sweep(schemes, cores, params, event_driven, &configs);
+	if (count <= 0)
+	{
+		if (count == 0)
+			fprintf(stderr, "The sweep has no configurations.\n");
+		free(configs);
+		return 1;
+	}
+
+	// Parse the whole trace once, checking it the same way a single run does
+	simulator_job_reader_t reader;
+	if (trace_open(&reader.trace, file_name) < 0)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		free(configs);
+		return 2;
+	}
+	reader.shared = NULL;
+	reader.jobs_read = 0;
+
+	// The counted jobs size the array; should the trace hold more, it grows
+	int jobs_ct = (reader.trace.jobs > 0) ? reader.trace.jobs : 1;
+	trace_job_t *jobs = malloc(jobs_ct * sizeof(trace_job_t));
+	int job_count = 0, status;
+	while ((status = read_next_job(&reader)) > 0)
+	{
+		if (job_count == jobs_ct)
+		{
+			jobs_ct *= 2;
+			trace_job_t *grown = realloc(jobs, jobs_ct * sizeof(trace_job_t));
+			if (!grown)
+			{
+				fprintf(stderr, "Out of memory.\n");
+				status = -1;
+				break;
+			}
+			jobs = grown;
+		}
+		jobs[job_count].arrival_time = reader.next.arrival_time;
+		jobs[job_count].run_time = reader.next.run_time;
+		jobs[job_count].priority = reader.next.priority;
+		jobs[job_count].deadline = reader.next.deadline;
+		job_count++;
+	}
+	trace_close(&reader.trace);
+	if (status < 0)
+	{
+		free(jobs);
+		free(configs);
+		return 2;
+	}
+
+	simulator_sweep_t sweep;
+	sweep.jobs = jobs;
+	sweep.job_count = job_count;
+	sweep.configs = configs;
+	sweep.results = calloc(count, sizeof(simulator_result_t));
+	sweep.status = calloc(count, sizeof(int));
+	sweep.count = count;
+	sweep.next = 0;
+	pthread_mutex_init(&sweep.lock, NULL);
+
+	if (threads > count)
+		threads = count;
+	pthread_t *pool = malloc(threads * sizeof(pthread_t));
+	int i;
+	for (i = 0; i < threads; i++)
+		pthread_create(&pool[i], NULL, sweep_worker, &sweep);
+	for (i = 0; i < threads; i++)
+		pthread_join(pool[i], NULL);
+
+	// The miss rate is only shown for traces with deadlines
+	int deadlines = 0;
+	for (i = 0; i < job_count; i++)
+		if (jobs[i].deadline > 0)
+			deadlines = 1;
+
+	printf("Swept %d configuration(s) of %d job(s) on %d thread(s)\n\n", count, job_count, threads);
+	printf("%-7s %7s %5s %15s %15s %15s", "scheme", "quantum", "cores", "waiting", "turnaround", "response");
+	if (deadlines)
+		printf(" %8s %10s", "missed", "lateness");
+	if (core_report)
+		printf(" %7s %10s %10s", "busy", "migrations", "steals");
+	if (latency_report)
+		printf(" %10s %10s %10s", "p99 wait", "p99 turn", "p99 resp");
+	printf("\n");
+	status = 0;
+	for (i = 0; i < count; i++)
+	{
+		simulator_config_t *config = &configs[i];
+		char quantum[16] = "-";
+		if (config->scheme == RR)
+			snprintf(quantum, sizeof(quantum), "%d", config->params.quantum);
+
+		printf("%-7s %7s %5d ", scheme_name(config->scheme), quantum, config->cores);
+		if (sweep.status[i] == 0)
+		{
+			simulator_result_t *result = &sweep.results[i];
+			printf("%15.2f %15.2f %15.2f", result->waiting_time, result->turnaround_time, result->response_time);
+			if (deadlines)
+			{
+				scheduler_deadline_stats_t *d = &result->deadlines;
+				printf(" %7.2f%% %10.2f", (d->jobs > 0) ? 100.0 * d->misses / d->jobs : 0,
+						(d->jobs > 0) ? (double)d->total_lateness / d->jobs : 0);
+			}
+			if (core_report)
+				printf(" %6.2f%% %10ld %10ld", 100 * result->utilization, result->migrations, result->steals);
+			if (latency_report)
+				printf(" %10d %10d %10d", result->latency[METRIC_WAITING][2], result->latency[METRIC_TURNAROUND][2],
+						result->latency[METRIC_RESPONSE][2]);
+			printf("\n");
+		}
+		else
+		{
+			printf("%15s %15s %15s\n", "error", "error", "error");
+			status = sweep.status[i];
+		}
+	}
+
+	pthread_mutex_destroy(&sweep.lock);
+	free(pool);
+	free(sweep.status);
+	free(sweep.results);
+	free(configs);
 	free(jobs);
+	return status;
+}
+
+
+int main(int argc, char **argv)
+{
+	int c;
+	int cores = 0, scheme = -1, quantum = 0;
+	int event_driven = 0, sweep = 0, threads = 0, core_report = 0, latency_report = 0;
+	int verbosity = VERBOSE_FULL, stats_report = 0;
+	char *cores_arg = NULL, *scheme_arg = NULL;
+	char *file_name, *export_path = NULL;
+	scheduler_params_t params;
+
+	memset(&params, 0, sizeof(params));
+
+	setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+	/*
+	 * Parse command line options.
+	 */
+	while ((c = getopt(argc, argv, "c:s:ev:wj:p:ulo:")) != -1)
+	{
+		switch (c)
+		{
+			case 'e':
+				event_driven = 1;
+				break;
+
+			case 'w':
+				sweep = 1;
+				break;
+
+			case 'u':
+				core_report = 1;
+				break;
+
+			case 'l':
+				latency_report = 1;
+				break;
+
+			case 'o':
+				export_path = optarg;
+				break;
+
+			case 'j':
+				threads = atoi(optarg);
+
+				if (threads <= 0)
+				{
+					fprintf(stderr, "Option -j <threads> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'v':
+				if (strcasecmp(optarg, "full") == 0) { verbosity = VERBOSE_FULL; }
+				else if (strcasecmp(optarg, "decisions") == 0) { verbosity = VERBOSE_DECISIONS; }
+				else if (strcasecmp(optarg, "summary") == 0) { verbosity = VERBOSE_SUMMARY; }
+				else if (strcasecmp(optarg, "stats") == 0) { verbosity = VERBOSE_SUMMARY; stats_report = 1; }
+				else
+				{
+					fprintf(stderr, "Option -v <verbosity> must be full, decisions, summary or stats.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'p':
+				if (parse_params(optarg, &params) < 0)
+				{
+					fprintf(stderr, "Option -p <params> requires name=value pairs with positive values or known policies.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'c':
+				cores_arg = optarg;
+				break;
+
+			case 's':
+				scheme_arg = optarg;
+				break;
+
+			case '?':
+				print_usage(argv[0]);
+				return 1;
+
+			default:
+				printf("....\n");
+				break;
+		}
+	}
+
+	if (cores_arg == NULL)
+	{
+		fprintf(stderr, "Required option -c <cores> is not present.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (scheme_arg == NULL)
+	{
+		fprintf(stderr, "Required option -s <scheme> is not present.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (optind == argc - 1)
+		file_name = argv[optind];
+	else
+	{
+		fprintf(stderr, "A single input file is required.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (sweep)
+	{
+		if (export_path != NULL)
+		{
+			fprintf(stderr, "Option -o <file> cannot be used with a sweep (-w).\n");
+			print_usage(argv[0]);
+			return 1;
+		}
+		if (threads == 0)
+			threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads <= 0)
+			threads = 1;
+		return run_sweep(file_name, scheme_arg, cores_arg, &params, event_driven, core_report, latency_report, threads);
+	}
+
+	cores = atoi(cores_arg);
+	if (cores <= 0)
+	{
+		fprintf(stderr, "Option -c <cores> require a positive number.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	int parsed = parse_scheme(scheme_arg, &scheme, &quantum);
+	if (parsed == -2)
+	{
+		fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of RR. (Eg: -s RR2)\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (parsed == -1)
+	{
+		fprintf(stderr, "Required option -s <scheme> is not present.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+
+	/*
+	 * Open the file, read the file, and populate the jobs data structure.
+	 */
+	simulator_job_reader_t reader;
+	if (trace_open(&reader.trace, file_name) < 0)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		return 2;
+	}
+	reader.shared = NULL;
+	reader.jobs_read = 0;
+
+	int job_id = reader.trace.jobs;
+
+	if (read_next_job(&reader) < 0)
+	{
+		trace_close(&reader.trace);
+		return 2;
+	}
+
+	simulator_job_export_t export;
+	if (export_path != NULL && open_job_export(&export, export_path) < 0)
+	{
+		fprintf(stderr, "Unable to create file \"%s\".\n", export_path);
+		trace_close(&reader.trace);
+		return 2;
+	}
+
+
+	/*
+	 * Run the simulation.
+	 */
+
+	printf("Loaded %d core(s) and %d job(s) using ", cores, job_id);
+	if (scheme == FCFS) { printf("First Come First Served (FCFS)"); }
+	else if (scheme == SJF) { printf("Non-preemptive Shortest Job First (SJF)"); }
+	else if (scheme == PSJF) { printf("Preemptive Shortest Job First (PSJF)"); }
+	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
+	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
+	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
+	else if (scheme == MLFQ) { printf("Multi-Level Feedback Queue (MLFQ)"); }
+	else if (scheme == CFS) { printf("Completely Fair Scheduler (CFS)"); }
+	else if (scheme == EDF) { printf("Non-preemptive Earliest Deadline First (EDF)"); }
+	else if (scheme == PEDF) { printf("Preemptive Earliest Deadline First (PEDF)"); }
+	else if (scheme == STRIDE) { printf("Stride Scheduling (STRIDE)"); }
+	else if (scheme == LOTTERY) { printf("Lottery Scheduling (LOTTERY)"); }
+	printf(" scheduling...\n\n");
+
+	params.quantum = quantum;
+	simulator_config_t config = { scheme, cores, params, event_driven, verbosity, core_report, latency_report, stats_report,
+			(export_path != NULL) ? &export : NULL };
+	simulator_result_t result;
+	int status = simulate(&config, &reader, &result);
+	trace_close(&reader.trace);
+	if (export_path != NULL && fclose(export.file) != 0 && status == 0)
+	{
+		fprintf(stderr, "Unable to write file \"%s\".\n", export_path);
+		status = 2;
+	}
+	if (status != 0)
+		return status;
+
+	printf("Average Waiting Time: %.2f\n", result.waiting_time);
+	printf("Average Turnaround Time: %.2f\n", result.turnaround_time);
+	printf("Average Response Time: %.2f\n", result.response_time);
+	if (result.deadlines.jobs > 0)
+		print_deadline_stats(&result.deadlines);
+	if (scheme == STRIDE || scheme == LOTTERY)
+		print_share_stats(&result.shares);
 
 	return 0;
 }
@@ -0,0 +1,124 @@
+/** @file tracebench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libtrace/libtrace.h"
+
+double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+  Writes a CSV trace of n jobs with increasing arrival times.
+ */
+void generate(const char *path, long n)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+	{
+		perror(path);
+		exit(2);
+	}
+	fprintf(f, "\"Arrival time\",\"Run time\",\"Priority\"\n");
+
+	srand(678);
+	long i;
+	int arrival = 0;
+	for (i = 0; i < n; i++)
+	{
+		arrival += rand() % 4;
+		fprintf(f, "%d,%d,%d\n", arrival, 1 + rand() % 1000, rand() % 10);
+	}
+	fclose(f);
+}
+
+/**
+  The parsing the simulator used to do: fgets into a line buffer, then strtok
+  and atoi on every column.
+ */
+long parse_stdio(const char *path, long *checksum)
+{
+	FILE *f = fopen(path, "r");
+	char line[1024 + 1];
+	long jobs = 0;
+
+	fgets(line, 1024, f);
+	while (fgets(line, 1024, f) != NULL)
+	{
+		char *arrival_time = strtok(line, ",");
+		char *run_time = strtok(NULL, ",");
+		char *priority = strtok(NULL, ",");
+		*checksum += atoi(arrival_time) + atoi(run_time) + atoi(priority);
+		jobs++;
+	}
+	fclose(f);
+	return jobs;
+}
+
+long parse_trace(const char *path, long *checksum)
+{
+	trace_t t;
+	trace_job_t job;
+	long jobs = 0;
+	int status;
+
+	if (trace_open(&t, path) < 0)
+		return -1;
+	while ((status = trace_next(&t, &job)) > 0)
+	{
+		*checksum += job.arrival_time + job.run_time + job.priority;
+		jobs++;
+	}
+	trace_close(&t);
+	if (status < 0)
+	{
+		fprintf(stderr, "Illegal file format (line %d).\n", t.line_number);
+		return -1;
+	}
+	return jobs;
+}
+
+int main(int argc, char **argv)
+{
+	long n = (argc > 1) ? atol(argv[1]) : 10000000;
+	const char *path = (argc > 2) ? argv[2] : "/tmp/tracebench.csv";
+
+	double start = now_seconds();
+	generate(path, n);
+	printf("Generated %ld jobs in %s (%.2f s)\n\n", n, path, now_seconds() - start);
+
+	FILE *f = fopen(path, "r");
+	fseek(f, 0, SEEK_END);
+	double mb = ftell(f) / 1e6;
+	fclose(f);
+
+	printf("%8s %10s %10s %12s\n", "parser", "time (s)", "MB/s", "Mjobs/s");
+
+	long sum_stdio = 0, sum_trace = 0;
+	start = now_seconds();
+	long jobs_stdio = parse_stdio(path, &sum_stdio);
+	double elapsed = now_seconds() - start;
+	printf("%8s %10.3f %10.1f %12.2f\n", "stdio", elapsed, mb / elapsed, jobs_stdio / elapsed / 1e6);
+
+	start = now_seconds();
+	long jobs_trace = parse_trace(path, &sum_trace);
+	elapsed = now_seconds() - start;
+	printf("%8s %10.3f %10.1f %12.2f\n", "mmap", elapsed, mb / elapsed, jobs_trace / elapsed / 1e6);
+
+	int status = 0;
+	if (jobs_stdio != jobs_trace || sum_stdio != sum_trace)
+	{
+		printf("The parsers disagree on the contents of the trace.\n");
+		status = 1;
+	}
+
+	remove(path);
+	return status;
+}
@@ -0,0 +1,76 @@
+/** @file traceconv.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtrace/libtrace.h"
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-c] <input trace> <output trace>\n", program_name);
+	fprintf(stderr, "       %s examples/proc1.csv proc1.trace\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Converts a trace (CSV or binary, detected from its contents) to the\n");
+	fprintf(stderr, "binary trace format the simulator loads directly.\n");
+	fprintf(stderr, "  -c  write CSV instead of binary\n");
+}
+
+int main(int argc, char **argv)
+{
+	trace_format_t format = TRACE_BINARY;
+	int c;
+
+	while ((c = getopt(argc, argv, "c")) != -1)
+	{
+		switch (c)
+		{
+			case 'c':
+				format = TRACE_CSV;
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (argc - optind != 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	trace_t in;
+	if (trace_open(&in, argv[optind]) < 0)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+
+	trace_writer_t out;
+	if (trace_writer_open(&out, argv[optind + 1], format) < 0)
+	{
+		fprintf(stderr, "Unable to create file \"%s\".\n", argv[optind + 1]);
+		trace_close(&in);
+		return 2;
+	}
+
+	trace_job_t job;
+	int status;
+	while ((status = trace_next(&in, &job)) > 0)
+		trace_write(&out, &job);
+
+	if (status < 0)
+		fprintf(stderr, "Illegal file format (line %d).\n", in.line_number);
+	if (trace_writer_close(&out) < 0)
+	{
+		fprintf(stderr, "Unable to write file \"%s\".\n", argv[optind + 1]);
+		status = -1;
+	}
+	trace_close(&in);
+
+	return (status < 0) ? 2 : 0;
+}
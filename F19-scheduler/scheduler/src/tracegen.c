@@ -0,0 +1,361 @@
+/** @file tracegen.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+
+#include "libtrace/libtrace.h"
+
+/*
+ * Random numbers come from splitmix64 rather than rand(), so a seed gives the
+ * same trace on every platform.
+ */
+typedef struct _tracegen_rng_t
+{
+	unsigned long long state;
+} tracegen_rng_t;
+
+unsigned long long rng_next(tracegen_rng_t *rng)
+{
+	unsigned long long z = (rng->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1], never 0 so it can go through log()
+double rng_uniform(tracegen_rng_t *rng)
+{
+	return ((rng_next(rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+double rng_exponential(tracegen_rng_t *rng, double mean)
+{
+	return -mean * log(rng_uniform(rng));
+}
+
+/*
+ * A distribution given on the command line as "name:arg,arg,...".
+ */
+#define MAX_ARGS 64
+
+typedef struct _tracegen_dist_t
+{
+	char name[16];
+	int argc;
+	double argv[MAX_ARGS];
+} tracegen_dist_t;
+
+// Parses the comma separated numbers of p into dist->argv
+int parse_args(const char *p, tracegen_dist_t *dist)
+{
+	dist->argc = 0;
+	while (*p != '\0')
+	{
+		char *end;
+		if (dist->argc == MAX_ARGS)
+			return -1;
+		dist->argv[dist->argc++] = strtod(p, &end);
+		if (end == p || (*end != ',' && *end != '\0'))
+			return -1;
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return 0;
+}
+
+int parse_dist(const char *spec, tracegen_dist_t *dist)
+{
+	const char *colon = strchr(spec, ':');
+	size_t len = (colon != NULL) ? (size_t)(colon - spec) : strlen(spec);
+	if (len == 0 || len >= sizeof(dist->name))
+		return -1;
+	memcpy(dist->name, spec, len);
+	dist->name[len] = '\0';
+	return parse_args((colon != NULL) ? colon + 1 : "", dist);
+}
+
+/*
+ * Arrival process state.
+ *
+ *   poisson:RATE                    exponential gaps, RATE jobs per time unit
+ *   bursty:RATE,PEAK,QUIET,BURST    Poisson at RATE for QUIET time units on
+ *                                   average, then at PEAK for BURST time
+ *                                   units on average, and so on
+ */
+typedef struct _tracegen_arrivals_t
+{
+	tracegen_dist_t dist;
+	double time;        // exact arrival time of the last job
+	int bursting;       // bursty: 1 during a burst
+	double phase_end;   // bursty: time the current phase ends
+} tracegen_arrivals_t;
+
+int check_arrivals(tracegen_dist_t *d)
+{
+	if (strcmp(d->name, "poisson") == 0)
+		return (d->argc == 1 && d->argv[0] > 0) ? 0 : -1;
+	if (strcmp(d->name, "bursty") == 0)
+		return (d->argc == 4 && d->argv[0] > 0 && d->argv[1] > 0 && d->argv[2] > 0 && d->argv[3] > 0) ? 0 : -1;
+	return -1;
+}
+
+int next_arrival(tracegen_arrivals_t *a, tracegen_rng_t *rng)
+{
+	double *arg = a->dist.argv;
+	if (strcmp(a->dist.name, "poisson") == 0)
+	{
+		a->time += rng_exponential(rng, 1.0 / arg[0]);
+	}
+	else
+	{
+		// A Poisson process is memoryless, so when a gap crosses the end of
+		// a phase the rest of it can be redrawn at the next phase's rate.
+		while (1)
+		{
+			double rate = a->bursting ? arg[1] : arg[0];
+			double t = a->time + rng_exponential(rng, 1.0 / rate);
+			if (t <= a->phase_end)
+			{
+				a->time = t;
+				break;
+			}
+			a->time = a->phase_end;
+			a->bursting = !a->bursting;
+			a->phase_end = a->time + rng_exponential(rng, a->bursting ? arg[3] : arg[2]);
+		}
+	}
+	return (a->time < INT_MAX) ? (int)a->time : INT_MAX;
+}
+
+/*
+ * Run time distributions, all rounded up to at least 1 time unit.
+ *
+ *   exp:MEAN                        exponential
+ *   pareto:ALPHA,MIN                heavy tailed, P(X > x) = (MIN / x)^ALPHA
+ *   bimodal:SHORT,LONG,FRACTION     exponential with mean LONG for FRACTION
+ *                                   of the jobs and mean SHORT for the rest
+ */
+int check_run_times(tracegen_dist_t *d)
+{
+	if (strcmp(d->name, "exp") == 0)
+		return (d->argc == 1 && d->argv[0] > 0) ? 0 : -1;
+	if (strcmp(d->name, "pareto") == 0)
+		return (d->argc == 2 && d->argv[0] > 0 && d->argv[1] > 0) ? 0 : -1;
+	if (strcmp(d->name, "bimodal") == 0)
+		return (d->argc == 3 && d->argv[0] > 0 && d->argv[1] > 0 && d->argv[2] >= 0 && d->argv[2] <= 1) ? 0 : -1;
+	return -1;
+}
+
+int next_run_time(tracegen_dist_t *d, tracegen_rng_t *rng)
+{
+	double *arg = d->argv;
+	double x;
+	if (strcmp(d->name, "exp") == 0)
+		x = rng_exponential(rng, arg[0]);
+	else if (strcmp(d->name, "pareto") == 0)
+		x = arg[1] / pow(rng_uniform(rng), 1.0 / arg[0]);
+	else
+		x = rng_exponential(rng, (rng_uniform(rng) <= arg[2]) ? arg[1] : arg[0]);
+
+	x = ceil(x);
+	if (x < 1)
+		return 1;
+	return (x < INT_MAX) ? (int)x : INT_MAX;
+}
+
+/*
+ * Priority mix "W0,W1,...": priority i is drawn with weight Wi.
+ */
+int check_priorities(tracegen_dist_t *d)
+{
+	double total = 0;
+	int i;
+	for (i = 0; i < d->argc; i++)
+	{
+		if (d->argv[i] < 0)
+			return -1;
+		total += d->argv[i];
+	}
+	return (total > 0) ? 0 : -1;
+}
+
+int next_priority(tracegen_dist_t *d, double total, tracegen_rng_t *rng)
+{
+	double x = rng_uniform(rng) * total;
+	int i;
+	for (i = 0; i < d->argc - 1; i++)
+	{
+		x -= d->argv[i];
+		if (x <= 0)
+			break;
+	}
+	return i;
+}
+
+/*
+ * Deadlines "slack:MIN,MAX": a job is due its run time times a factor drawn
+ * uniformly from [MIN, MAX] after it arrives.
+ */
+int check_deadlines(tracegen_dist_t *d)
+{
+	if (strcmp(d->name, "slack") == 0)
+		return (d->argc == 2 && d->argv[0] >= 1 && d->argv[1] >= d->argv[0]) ? 0 : -1;
+	return -1;
+}
+
+int next_deadline(tracegen_dist_t *d, int run_time, tracegen_rng_t *rng)
+{
+	double slack = d->argv[0] + (d->argv[1] - d->argv[0]) * rng_uniform(rng);
+	double x = ceil(run_time * slack);
+	return (x < INT_MAX) ? (int)x : INT_MAX;
+}
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [options] <output trace>\n", program_name);
+	fprintf(stderr, "       %s -n 1000000 -a poisson:0.5 -r pareto:1.5,2 big.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -n <jobs>      number of jobs (default 1000)\n");
+	fprintf(stderr, "  -s <seed>      random seed (default 1)\n");
+	fprintf(stderr, "  -a <arrivals>  poisson:RATE or bursty:RATE,PEAK,QUIET,BURST\n");
+	fprintf(stderr, "                 (default poisson:0.1)\n");
+	fprintf(stderr, "  -r <run times> exp:MEAN, pareto:ALPHA,MIN or bimodal:SHORT,LONG,FRACTION\n");
+	fprintf(stderr, "                 (default exp:8)\n");
+	fprintf(stderr, "  -p <weights>   weights of priorities 0, 1, ... as W0,W1,...\n");
+	fprintf(stderr, "                 (default 1,1,1,1,1)\n");
+	fprintf(stderr, "  -d <deadlines> slack:MIN,MAX, due MIN to MAX times the run time after\n");
+	fprintf(stderr, "                 arrival (default no deadlines)\n");
+	fprintf(stderr, "  -f <format>    csv (default) or binary\n");
+}
+
+int main(int argc, char **argv)
+{
+	long jobs = 1000;
+	unsigned long long seed = 1;
+	const char *arrival_spec = "poisson:0.1";
+	const char *run_spec = "exp:8";
+	const char *priority_spec = "1,1,1,1,1";
+	const char *deadline_spec = NULL;
+	trace_format_t format = TRACE_CSV;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:a:r:p:d:f:")) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				jobs = atol(optarg);
+				if (jobs < 0 || jobs > INT_MAX)
+				{
+					fprintf(stderr, "Option -n <jobs> requires a number between 0 and %d.\n", INT_MAX);
+					return 1;
+				}
+				break;
+
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+
+			case 'a':
+				arrival_spec = optarg;
+				break;
+
+			case 'r':
+				run_spec = optarg;
+				break;
+
+			case 'p':
+				priority_spec = optarg;
+				break;
+
+			case 'd':
+				deadline_spec = optarg;
+				break;
+
+			case 'f':
+				if (strcmp(optarg, "csv") == 0)
+					format = TRACE_CSV;
+				else if (strcmp(optarg, "binary") == 0)
+					format = TRACE_BINARY;
+				else
+				{
+					fprintf(stderr, "Option -f <format> must be csv or binary.\n");
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (argc - optind != 1)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	tracegen_arrivals_t arrivals;
+	tracegen_dist_t run_times, priorities, deadlines;
+	if (parse_dist(arrival_spec, &arrivals.dist) < 0 || check_arrivals(&arrivals.dist) < 0)
+	{
+		fprintf(stderr, "Invalid arrival process \"%s\".\n", arrival_spec);
+		return 1;
+	}
+	if (parse_dist(run_spec, &run_times) < 0 || check_run_times(&run_times) < 0)
+	{
+		fprintf(stderr, "Invalid run time distribution \"%s\".\n", run_spec);
+		return 1;
+	}
+	if (parse_args(priority_spec, &priorities) < 0 || check_priorities(&priorities) < 0)
+	{
+		fprintf(stderr, "Invalid priority weights \"%s\".\n", priority_spec);
+		return 1;
+	}
+	if (deadline_spec != NULL && (parse_dist(deadline_spec, &deadlines) < 0 || check_deadlines(&deadlines) < 0))
+	{
+		fprintf(stderr, "Invalid deadlines \"%s\".\n", deadline_spec);
+		return 1;
+	}
+
+	double priority_total = 0;
+	int i;
+	for (i = 0; i < priorities.argc; i++)
+		priority_total += priorities.argv[i];
+
+	tracegen_rng_t rng = { seed };
+	arrivals.time = 0;
+	arrivals.bursting = 0;
+	arrivals.phase_end = (strcmp(arrivals.dist.name, "bursty") == 0) ? rng_exponential(&rng, arrivals.dist.argv[2]) : 0;
+
+	trace_writer_t out;
+	if (trace_writer_open(&out, argv[optind], format) < 0)
+	{
+		fprintf(stderr, "Unable to create file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+
+	// The first job arrives at time 0, like in the example traces
+	long n;
+	for (n = 0; n < jobs; n++)
+	{
+		trace_job_t job;
+		job.arrival_time = (n == 0) ? 0 : next_arrival(&arrivals, &rng);
+		job.run_time = next_run_time(&run_times, &rng);
+		job.priority = next_priority(&priorities, priority_total, &rng);
+		job.deadline = (deadline_spec != NULL) ? next_deadline(&deadlines, job.run_time, &rng) : 0;
+		trace_write(&out, &job);
+	}
+
+	if (trace_writer_close(&out) < 0)
+	{
+		fprintf(stderr, "Unable to write file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+	return 0;
+}